@@ -0,0 +1,171 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// ABI call latency benchmark app.
+// CONFIG_BADGEABI_BENCH builds it with the firmware's compiler and embeds it; start it with `badgert_bench`.
+// Run it both with and without CONFIG_BADGEABI_ENABLE_KERNEL to compare the two.
+// Results are printed as `abibench: <name> min <cycles> med <cycles> p99 <cycles>`,
+// which `tools/benchcmp.py` compares against a baseline.
+// The firmware also runs under Espressif's QEMU (`idf.py qemu monitor`),
+// so trap overhead can be tracked in CI without hardware.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <display.h>
+#include <gpio.h>
+#include <iomask.h>
+
+// Number of samples per benchmark.
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES 256
+#endif
+
+// GPIO pin used for the `io_read` and `io_write` benchmarks.
+#ifndef BENCH_GPIO
+#define BENCH_GPIO 0
+#endif
+
+// ABI functions without a public header.
+extern int     __abi_nop();
+extern int64_t uptime_us();
+extern void   *__mem_map(size_t len, size_t min_align, bool allow_exec);
+extern void    __mem_unmap(void *addr);
+extern uint32_t __cycle_count();
+
+// Samples of the current benchmark.
+static uint32_t samples[BENCH_SAMPLES];
+// Overhead of reading the cycle counter twice.
+static uint32_t overhead;
+
+// Read the cycle counter.
+// The ESP32-C6 has no user-readable `cycle` CSR, so this is an ABI call; its cost is in `overhead`.
+static inline uint32_t cycles() {
+	return __cycle_count();
+}
+
+// Measure one sample of `code`.
+#define SAMPLE(code) ({ \
+	uint32_t start = cycles(); \
+	code; \
+	uint32_t end = cycles(); \
+	end - start; \
+})
+
+// Measure all samples of `code`, with `setup` and `teardown` not counted.
+#define BENCH(name, setup, code, teardown) do { \
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) { \
+		setup; \
+		uint32_t t = SAMPLE(code); \
+		teardown; \
+		samples[i] = t > overhead ? t - overhead : 0; \
+	} \
+	report(name); \
+} while (0)
+
+// Sort the samples; `qsort` is not part of the ABI.
+static void sort() {
+	for (size_t i = 1; i < BENCH_SAMPLES; i++) {
+		uint32_t t = samples[i];
+		size_t   j = i;
+		for (; j > 0 && samples[j - 1] > t; j--) samples[j] = samples[j - 1];
+		samples[j] = t;
+	}
+}
+
+// Print the min, median and 99th percentile of the samples.
+static void report(const char *name) {
+	sort();
+	printf("abibench: %s min %lu med %lu p99 %lu\n",
+		name,
+		(unsigned long) samples[0],
+		(unsigned long) samples[BENCH_SAMPLES / 2],
+		(unsigned long) samples[BENCH_SAMPLES * 99 / 100]
+	);
+}
+
+int main(int argc, char **argv) {
+	// Measure the overhead of the measurement itself.
+	overhead = UINT32_MAX;
+	for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+		uint32_t t = SAMPLE();
+		if (t < overhead) overhead = t;
+	}
+	printf("abibench: overhead %lu cycles\n", (unsigned long) overhead);
+	
+	// Plain ABI calls.
+	BENCH("null", , __abi_nop(), );
+	BENCH("uptime_us", , uptime_us(), );
+	
+	// Memory copies of several sizes.
+	static uint8_t src[4096], dst[4096];
+	BENCH("memcpy_16",   , memcpy(dst, src, 16),   );
+	BENCH("memcpy_256",  , memcpy(dst, src, 256),  );
+	BENCH("memcpy_4096", , memcpy(dst, src, 4096), );
+	
+	// Soft-float helpers.
+	volatile float  fa = 1.5f, fb = 2.25f;
+	volatile double da = 1.5,  db = 2.25;
+	BENCH("__addsf3", , fa = fa + fb, );
+	BENCH("__mulsf3", , fa = fa * fb, );
+	BENCH("__divsf3", , fa = fa / fb, );
+	BENCH("__adddf3", , da = da + db, );
+	BENCH("__muldf3", , da = da * db, );
+	
+	// GPIO.
+	BENCH("io_read",  , io_read(BENCH_GPIO), );
+	BENCH("io_write", , io_write(BENCH_GPIO, false), );
+	BENCH("io_read_mask",  , io_read_mask(), );
+	BENCH("io_write_mask", , io_write_mask(0, 1lu << BENCH_GPIO), );
+	
+	// GPIO toggle rate: cycles per period of a square wave, as used by bit-banged protocols.
+	io_set_mode(BENCH_GPIO, IO_MODE_OUTPUT);
+	BENCH("toggle_io_write", , {
+		io_write(BENCH_GPIO, true);
+		io_write(BENCH_GPIO, false);
+	}, );
+	BENCH("toggle_io_write_mask", , {
+		io_write_mask(1lu << BENCH_GPIO, 0);
+		io_write_mask(0, 1lu << BENCH_GPIO);
+	}, );
+	
+	// Display.
+	if (display_count() > 0) {
+		int id;
+		display_get_ids(&id, 1);
+		static uint16_t pixels[8 * 8];
+		BENCH("display_write_partial", , display_write_partial(id, pixels, sizeof(pixels), 0, 0, 8, 8), );
+	} else {
+		printf("abibench: no display, skipping display_write_partial\n");
+	}
+	
+	// Memory mapping.
+	void *mem = NULL;
+	BENCH("__mem_map",   , mem = __mem_map(256, 4, false), __mem_unmap(mem));
+	BENCH("__mem_unmap", mem = __mem_map(256, 4, false), __mem_unmap(mem), );
+	
+	return 0;
+}
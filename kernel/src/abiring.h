@@ -0,0 +1,135 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Shared memory layout of the batched ABI submission ring.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// System call number used to submit the ring.
+#define ABI_RING_SYSCALL 516
+// Maximum number of entries in a ring.
+#define ABI_RING_MAX_ENTRIES 256
+
+// Completion flag: ABI index was out of range and the call was not made.
+#define ABI_CQE_EINVAL 0x00000001
+
+// A queued ABI call.
+typedef struct {
+	// Index into the ABI table.
+	uint32_t index;
+	// Opaque value copied into the matching completion.
+	uint32_t user_data;
+	// Argument registers `a0` through `a7`.
+	long     args[8];
+} abi_sqe_t;
+
+// The result of a queued ABI call.
+typedef struct {
+	// Copied from the matching submission.
+	uint32_t user_data;
+	// Completion flags.
+	uint32_t flags;
+	// Return value registers `a0` and `a1`.
+	long     ret[2];
+} abi_cqe_t;
+
+// Header of an ABI submission ring.
+// The submission and completion queues directly follow the header.
+typedef struct {
+	// Next submission to be run, written by the kernel.
+	uint32_t sq_head;
+	// Next free submission slot, written by the app.
+	uint32_t sq_tail;
+	// Next completion to be read, written by the app.
+	uint32_t cq_head;
+	// Next free completion slot, written by the kernel.
+	uint32_t cq_tail;
+	// Number of entries minus one; the number of entries is a power of two.
+	uint32_t mask;
+	// Number of completions discarded because the completion queue was full.
+	uint32_t cq_overflow;
+} abi_ring_t;
+
+// Get the submission queue of a ring.
+static inline abi_sqe_t *abi_ring_sq(abi_ring_t *ring) {
+	return (abi_sqe_t *) (ring + 1);
+}
+
+// Get the completion queue of a ring.
+static inline abi_cqe_t *abi_ring_cq(abi_ring_t *ring) {
+	return (abi_cqe_t *) (abi_ring_sq(ring) + ring->mask + 1);
+}
+
+// Get the size in bytes of a ring with a certain number of entries.
+static inline size_t abi_ring_size(uint32_t entries) {
+	return sizeof(abi_ring_t) + entries * (sizeof(abi_sqe_t) + sizeof(abi_cqe_t));
+}
+
+// Queue an ABI call without submitting it.
+// Returns false if the submission queue is full.
+static inline bool abi_ring_push(abi_ring_t *ring, uint32_t index, uint32_t user_data, const long *args, size_t nargs) {
+	uint32_t tail = ring->sq_tail;
+	if (tail - __atomic_load_n(&ring->sq_head, __ATOMIC_ACQUIRE) > ring->mask) return false;
+	
+	abi_sqe_t *sqe = &abi_ring_sq(ring)[tail & ring->mask];
+	sqe->index     = index;
+	sqe->user_data = user_data;
+	for (size_t i = 0; i < 8; i++) {
+		sqe->args[i] = i < nargs ? args[i] : 0;
+	}
+	__atomic_store_n(&ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+// Take a completion from the ring.
+// Returns false if there are no completions.
+static inline bool abi_ring_pop(abi_ring_t *ring, abi_cqe_t *out) {
+	uint32_t head = ring->cq_head;
+	if (head == __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE)) return false;
+	*out = abi_ring_cq(ring)[head & ring->mask];
+	__atomic_store_n(&ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#ifdef __riscv
+// Run all queued ABI calls in order using a single system call.
+// Returns the number of calls that were run.
+static inline uint32_t abi_ring_submit(void) {
+	register long a0 asm("a0") = ABI_RING_SYSCALL;
+	asm volatile ("ecall" : "+r" (a0) :: "memory");
+	return a0;
+}
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -23,6 +23,7 @@
 */
 
 #include "kernel.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string.h>
 
@@ -116,6 +117,63 @@ static void regdump(const riscv_regs_t *regs, unsigned long pc) {
 	printf("MEPC:     0x%08lx\n", mepc);
 }
 
+// Run all queued calls in the ABI submission ring of a process.
+// Returns the number of calls made.
+static uint32_t runABIRing(ctx_t *ctx) {
+	abi_ring_t *ring = ctx->u_abi_ring;
+	if (!ring) return 0;
+	
+	// The calls clobber the argument and return registers.
+	riscv_regs_t saved = ctx->u_regs;
+	uint32_t     mask  = ctx->u_abi_ring_mask;
+	abi_sqe_t   *sq    = abi_ring_sq(ring);
+	abi_cqe_t   *cq    = (abi_cqe_t *) (sq + mask + 1);
+	uint32_t     count = 0;
+	
+	uint32_t head = ring->sq_head;
+	uint32_t tail = __atomic_load_n(&ring->sq_tail, __ATOMIC_ACQUIRE);
+	// Never run more than one lap of the ring, even if the app corrupted the indices.
+	if (tail - head > mask + 1) head = tail - mask - 1;
+	
+	for (; head != tail; head++, count++) {
+		abi_sqe_t sqe = sq[head & mask];
+		abi_cqe_t cqe = { sqe.user_data, 0, { -1, 0 } };
+		
+		if (sqe.index < ctx->u_abi_size) {
+			// Arguments are passed the same way as the ABI call wrapper does.
+			ctx->u_regs.t0 = sqe.args[0];
+			ctx->u_regs.t1 = sqe.args[1];
+			ctx->u_regs.a2 = sqe.args[2];
+			ctx->u_regs.a3 = sqe.args[3];
+			ctx->u_regs.a4 = sqe.args[4];
+			ctx->u_regs.a5 = sqe.args[5];
+			ctx->u_regs.a6 = sqe.args[6];
+			ctx->u_regs.a7 = sqe.args[7];
+			uint64_t start = trace::enabled ? trace::cycles() : 0;
+			makeABICall(ctx, ctx->u_abi_table[sqe.index]);
+			if (trace::enabled) {
+				trace::record(trace::EV_ABICALL, ctx->pid, sqe.index, start, trace::cycles(), ctx->u_regs.a0);
+			}
+			cqe.ret[0] = ctx->u_regs.a0;
+			cqe.ret[1] = ctx->u_regs.a1;
+		} else {
+			cqe.flags |= ABI_CQE_EINVAL;
+		}
+		
+		// Post the completion, unless the app isn't keeping up.
+		if (ring->cq_tail - ring->cq_head > mask) {
+			ring->cq_overflow++;
+		} else {
+			cq[ring->cq_tail & mask] = cqe;
+			__atomic_store_n(&ring->cq_tail, ring->cq_tail + 1, __ATOMIC_RELEASE);
+		}
+	}
+	__atomic_store_n(&ring->sq_head, head, __ATOMIC_RELEASE);
+	
+	ctx->u_regs = saved;
+	return count;
+}
+
 } // namespace kernel
 
 // ECALL handler.
@@ -136,6 +194,7 @@ bool ecallHandler(int syscall, int a1, int a2, int a3) {
 			} else {
 				regdump(&ctx->u_regs, ctx->u_pc);
 				std::cout << "Terminating process " << ctx->pid << '\n';
+				trace::instant(trace::EV_PROC_EXIT, ctx->pid, 0, -1);
 			}
 			return 1;
 		
@@ -143,10 +202,13 @@ bool ecallHandler(int syscall, int a1, int a2, int a3) {
 			if (ctx->is_super) goto priv;
 			// ABI call.
 			if (a1 >= 0 && a1 < ctx->u_abi_size) {
-				std::cout << "ABI call #" << std::dec << a1 << '\n';
+				uint64_t start = trace::enabled ? trace::cycles() : 0;
 				ctx->is_super = 1;
 				makeABICall(ctx, ctx->u_abi_table[a1]);
 				ctx->is_super = 0;
+				if (trace::enabled) {
+					trace::record(trace::EV_ABICALL, ctx->pid, a1, start, trace::cycles(), ctx->u_regs.a0);
+				}
 				return 0;
 			} else {
 				std::cout << "Unimplemented ABI call #" << std::dec << a1 << '\n';
@@ -155,19 +217,30 @@ bool ecallHandler(int syscall, int a1, int a2, int a3) {
 				} else {
 					regdump(&ctx->u_regs, ctx->u_pc);
 					std::cout << "Terminating process " << ctx->pid << '\n';
+					trace::instant(trace::EV_PROC_EXIT, ctx->pid, 0, -1);
 				}
 				return 1;
 			}
 		
+		case syscall_t::SYS_ABIBATCH:
+			if (ctx->is_super) goto priv;
+			// Batched ABI calls.
+			ctx->is_super = 1;
+			ctx->u_regs.a0 = runABIRing(ctx);
+			ctx->is_super = 0;
+			return 0;
+		
 		case syscall_t::SYS_EXIT:
 			if (ctx->is_super) goto priv;
 			std::cout << "Process " << ctx->pid << " exited with code " << a1 << '\n';
+			trace::instant(trace::EV_PROC_EXIT, ctx->pid, 0, a1);
 			// Simply jump back to machine mode.
 			return 1;
 		
 		case syscall_t::SYS_USERJUMP:
 			if (!ctx->is_super) goto nopriv;
 			std::cout << "Process " << ctx->pid << " starting\n";
+			trace::instant(trace::EV_PROC_START, ctx->pid, 0, ctx->u_pc);
 			// Extremely simple jump to user mode.
 			return 0;
 		
@@ -188,6 +261,7 @@ bool ecallHandler(int syscall, int a1, int a2, int a3) {
 	std::cout << "Process " << ctx->pid << " made M-mode system call 0x" << std::hex << syscall << " from U-mode\n";
 	regdump(&ctx->u_regs, ctx->u_pc);
 	std::cout << "Terminating process " << ctx->pid << '\n';
+	trace::instant(trace::EV_PROC_EXIT, ctx->pid, 0, -1);
 	return 1;
 	
 	priv:
@@ -206,6 +280,7 @@ bool trapHandler() {
 	asm ("csrr %0, mscratch" : "=r" (ctx));
 	size_t mcause;
 	asm ("csrr %0, mcause" : "=r" (mcause));
+	trace::instant(trace::EV_TRAP, ctx->is_super ? 0 : ctx->pid, mcause, ctx->is_super ? ctx->m_pc : ctx->u_pc);
 	
 	if (ctx->is_super) {
 		// It was the kernel.
@@ -242,6 +317,7 @@ bool trapHandler() {
 	} else {
 		// It was a process.
 		regdump(&ctx->u_regs, ctx->u_pc);
+		trace::instant(trace::EV_PROC_EXIT, ctx->pid, 0, -1);
 	}
 	
 	// Return to M-mode.
@@ -284,6 +360,9 @@ static inline uint32_t writeJAL(int32_t offset) {
 	return output.raw;
 }
 
+// Context used by tasks that do not run a user process.
+static ctx_t defualtCtx;
+
 // Do all generic setup required for user mode.
 void init() {
 	// Disable interrupts.
@@ -310,23 +389,35 @@ void init() {
 	*instptr = writeJAL(isrptr - interruptPointer);
 	
 	
-	// Copy customISR to RAM.
-	mem = malloc(customISRSize);
-	offs = (size_t) mem - (size_t) &customISR;
-	std::cout << "Loaded interrupt handler to 0x" << std::hex << (size_t) mem << " (offset 0x" << offs << ")\n";
-	memcpy(mem, (const void*) &customISR, customISRSize);
-	
 	// Read complete interrupt vector table.
 	for (size_t i = 0; i < 32; i++) {
 		size_t addr = readJAL(instptr[i]) + (size_t) &instptr[i];
 		interruptVectorTable[i] = addr;
 	}
 	
-	// // Write interrupt vector table.
-	// for (size_t i = 1; i < 32; i++) {
-	// 	size_t val = writeJAL((size_t) mem - (size_t) &instptr[i]);
-	// 	instptr[i] = val;
-	// }
+	// Interrupts may now arrive before the first task switch, so make sure there is a context.
+	defualtCtx.is_super = 1;
+	asm volatile ("csrw mscratch, %0" :: "r" (&defualtCtx));
+	
+	// Copy one customISR per interrupt cause to RAM.
+	size_t stride = (customISRSize + 3) & ~3;
+	mem = malloc(stride * 32);
+	std::cout << "Loaded interrupt handlers to 0x" << std::hex << (size_t) mem << '\n';
+	for (size_t i = 1; i < 32; i++) {
+		size_t stub = (size_t) mem + stride * i;
+		memcpy((void *) stub, (const void*) &customISR, customISRSize);
+		
+		// Forward directly to the original handler of this cause.
+		uint32_t *fwd = (uint32_t *) (stub + customISRForward);
+		*fwd = writeJAL(interruptVectorTable[i] - (size_t) fwd);
+	}
+	
+	// Write interrupt vector table.
+	for (size_t i = 1; i < 32; i++) {
+		size_t stub = (size_t) mem + stride * i;
+		instptr[i] = writeJAL(stub - (size_t) &instptr[i]);
+	}
+	asm volatile ("fence.i");
 	
 	
 	// Enable interrupts.
@@ -335,16 +426,36 @@ void init() {
 
 // Set active context.
 void setCtx(ctx_t *ctx) {
+	ctx_t *prev = getCtx();
+	if (trace::enabled && prev != ctx) {
+		trace::instant(trace::EV_CTX_SWITCH, prev ? prev->pid : 0, ctx->pid, 0);
+	}
+	if (ctx->u_pmp_valid) loadPMP(ctx->u_pmp);
 	asm volatile ("csrw mscratch, %0" :: "r" (ctx));
 	ctx->is_super = 1;
 }
 
 // Set active context to default context.
-static ctx_t defualtCtx;
 void setDefaultCtx() {
 	setCtx(&defualtCtx);
 }
 
+// Switch to the context of another task, leaving its privilege state as-is.
+// A null context selects the default context.
+// Intended to be called from the scheduler's task switch hook.
+KERNEL_IRAM void switchCtx(ctx_t *ctx) {
+	if (!ctx) {
+		ctx = &defualtCtx;
+		ctx->is_super = 1;
+	}
+	ctx_t *prev;
+	asm volatile ("csrr %0, mscratch" : "=r" (prev));
+	if (prev == ctx) return;
+	trace::instant(trace::EV_CTX_SWITCH, prev ? prev->pid : 0, ctx->pid, 0);
+	if (ctx->u_pmp_valid) loadPMP(ctx->u_pmp);
+	asm volatile ("csrw mscratch, %0" :: "r" (ctx));
+}
+
 // Get active context.
 ctx_t *getCtx() {
 	ctx_t *out;
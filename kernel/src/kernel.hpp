@@ -27,6 +27,8 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "abiring.h"
+
 #ifndef XLEN
 #define XLEN 32
 #endif
@@ -35,6 +37,21 @@
 #define PMP_SIZE 16
 #endif
 
+// First PMP entry reserved for user mode protection.
+#ifndef PMP_USER_FIRST
+#define PMP_USER_FIRST 0
+#endif
+
+// Number of PMP entries reserved for user mode protection.
+#ifndef PMP_USER_COUNT
+#define PMP_USER_COUNT PMP_SIZE
+#endif
+
+// Places code that runs during task switches in internal RAM.
+#ifndef KERNEL_IRAM
+#define KERNEL_IRAM __attribute__((section(".iram1.kernel")))
+#endif
+
 namespace kernel {
 
 // Table of names for all integer registers.
@@ -82,6 +99,8 @@ extern const size_t customTrapSize;
 void customISR();
 // Size of interrupt handler.
 extern const size_t customISRSize;
+// Offset of the forwarding JAL in the interrupt handler.
+extern const size_t customISRForward;
 
 // ECALL handler.
 // Returns 1 to return to machine mode, 0 to return to user mode.
@@ -108,8 +127,12 @@ enum syscall_t {
 	// Machine:  Create usermode context.
 	// Sets usermode PC to `a1`, SP to `a2` and all other regs to 0.
 	SYS_USERENTER,
+	// Usermode: Run all queued calls in the ABI submission ring.
+	SYS_ABIBATCH,
 };
 
+static_assert(SYS_ABIBATCH == ABI_RING_SYSCALL, "SYS_ABIBATCH must equal ABI_RING_SYSCALL");
+
 // Storage for RISCV PMP entries.
 struct riscv_pmp_t {
 	union {
@@ -122,6 +145,27 @@ struct riscv_pmp_t {
 	unsigned long address[PMP_SIZE];
 };
 
+static_assert(PMP_USER_FIRST % sizeof(unsigned long) == 0, "PMP_USER_FIRST must start a pmpcfg register");
+static_assert(PMP_USER_COUNT % sizeof(unsigned long) == 0, "PMP_USER_COUNT must fill whole pmpcfg registers");
+static_assert(PMP_USER_FIRST + PMP_USER_COUNT <= PMP_SIZE, "PMP_USER_FIRST + PMP_USER_COUNT must not exceed PMP_SIZE");
+
+// PMP permission bits.
+enum pmp_perm_t : uint8_t {
+	PMP_R = 0x01,
+	PMP_W = 0x02,
+	PMP_X = 0x04,
+};
+
+// A range of memory to grant to user mode.
+struct pmp_region_t {
+	// Base address, a multiple of 4.
+	size_t  base;
+	// Length in bytes, a multiple of 4.
+	size_t  length;
+	// Permissions from `pmp_perm_t`.
+	uint8_t perm;
+};
+
 // Complete context for a usermode program.
 // WARNING: This struct is directly referred to in assembly!
 struct ctx_t {
@@ -130,7 +174,7 @@ struct ctx_t {
 	// Machine:  Registers storage.
 	riscv_regs_t  m_regs;
 	
-	// Scratch pad for trap handler.
+	// Scratch pad for trap handler; scratch[7] is reserved for the interrupt fast path.
 	uint32_t      scratch[8];
 	
 	// Usermode: Program counter.
@@ -156,10 +200,18 @@ struct ctx_t {
 	int is_super;
 	
 	// Usermode: PMP settings.
-	// riscv_pmp_t   u_pmp;
+	riscv_pmp_t   u_pmp;
+	// Usermode: Whether `u_pmp` is valid and should be loaded.
+	int           u_pmp_valid;
 	
 	// Program ID, intended for use by the ABI implementation.
 	int pid;
+	
+	// Usermode: ABI submission ring, if any.
+	abi_ring_t *u_abi_ring;
+	// Usermode: Number of ABI submission ring entries minus one.
+	// Kept here because the copy in the ring is writable by the process.
+	uint32_t    u_abi_ring_mask;
 };
 
 static_assert(offsetof(ctx_t, u_regs) == 0, "offset of u_regs must be 0");
@@ -180,9 +232,20 @@ void init();
 void setCtx(ctx_t *ctx);
 // Set active context to default context.
 void setDefaultCtx();
+// Switch to the context of another task, leaving its privilege state as-is.
+// A null context selects the default context.
+// Intended to be called from the scheduler's task switch hook.
+void switchCtx(ctx_t *ctx);
 // Get active context.
 ctx_t *getCtx();
 
+// Compute the PMP entries granting user mode access to `regions`.
+// Sorts the regions and merges adjacent ones with equal permissions.
+// Returns false if they do not fit in the PMP_USER_COUNT reserved entries.
+bool buildPMP(riscv_pmp_t &out, pmp_region_t *regions, size_t count);
+// Load the reserved PMP entries from a precomputed image.
+void loadPMP(const riscv_pmp_t &pmp);
+
 }
 
 extern "C" {
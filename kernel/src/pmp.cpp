@@ -0,0 +1,125 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "kernel.hpp"
+
+#include <algorithm>
+#include <string.h>
+
+
+
+namespace kernel {
+
+// PMP address matching modes.
+enum {
+	PMP_A_OFF   = 0x00,
+	PMP_A_TOR   = 0x08,
+	PMP_A_NAPOT = 0x18,
+};
+
+// Compute the PMP entries granting user mode access to `regions`.
+// Sorts the regions and merges adjacent ones with equal permissions.
+// Returns false if they do not fit in the PMP_USER_COUNT reserved entries.
+bool buildPMP(riscv_pmp_t &out, pmp_region_t *regions, size_t count) {
+	memset(&out, 0, sizeof(out));
+	
+	// Sort regions by base address.
+	std::sort(regions, regions + count, [](const pmp_region_t &a, const pmp_region_t &b) {
+		return a.base < b.base;
+	});
+	
+	// Merge touching regions with the same permissions.
+	size_t merged = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (!regions[i].length) continue;
+		if (merged && regions[merged-1].perm == regions[i].perm
+				&& regions[merged-1].base + regions[merged-1].length == regions[i].base) {
+			regions[merged-1].length += regions[i].length;
+		} else {
+			regions[merged++] = regions[i];
+		}
+	}
+	
+	// Encode the entries.
+	size_t entry = PMP_USER_FIRST;
+	size_t end   = PMP_USER_FIRST + PMP_USER_COUNT;
+	size_t top   = 0;
+	bool   isTop = false;
+	for (size_t i = 0; i < merged; i++) {
+		const pmp_region_t &reg = regions[i];
+		size_t len = reg.length;
+		
+		if (len >= 8 && !(len & (len - 1)) && !(reg.base & (len - 1))) {
+			// Naturally aligned power of two; one NAPOT entry.
+			if (entry + 1 > end) return false;
+			out.address[entry] = (reg.base >> 2) | ((len >> 3) - 1);
+			out.cfg[entry]     = reg.perm | PMP_A_NAPOT;
+			entry ++;
+			isTop = false;
+			
+		} else {
+			// Arbitrary range; one TOR entry, plus one for the bottom if it
+			// doesn't coincide with the top of the previous region.
+			bool needBase = !isTop || top != reg.base;
+			if (entry + 1 + needBase > end) return false;
+			if (needBase) {
+				out.address[entry] = reg.base >> 2;
+				out.cfg[entry]     = PMP_A_OFF;
+				entry ++;
+			}
+			out.address[entry] = (reg.base + len) >> 2;
+			out.cfg[entry]     = reg.perm | PMP_A_TOR;
+			entry ++;
+			top   = reg.base + len;
+			isTop = true;
+		}
+	}
+	
+	return true;
+}
+
+static_assert(PMP_SIZE == 16 && XLEN == 32, "loadPMP only supports 16 PMP entries on RV32");
+
+// Write PMP entry `n` if it is reserved for user mode.
+#define PMP_LOAD_ADDR(n) \
+	if ((n) >= PMP_USER_FIRST && (n) < PMP_USER_FIRST + PMP_USER_COUNT) { \
+		asm volatile ("csrw pmpaddr" #n ", %0" :: "r" (pmp.address[n])); \
+	}
+// Write PMP configuration register `n` if it is reserved for user mode.
+#define PMP_LOAD_CFG(n) \
+	if ((n) * sizeof(long) >= PMP_USER_FIRST && (n) * sizeof(long) < PMP_USER_FIRST + PMP_USER_COUNT) { \
+		asm volatile ("csrw pmpcfg" #n ", %0" :: "r" (pmp.raw_cfg[n])); \
+	}
+
+// Load the reserved PMP entries from a precomputed image.
+KERNEL_IRAM void loadPMP(const riscv_pmp_t &pmp) {
+	// Addresses first, then the configuration that enables them.
+	PMP_LOAD_ADDR(0)  PMP_LOAD_ADDR(1)  PMP_LOAD_ADDR(2)  PMP_LOAD_ADDR(3)
+	PMP_LOAD_ADDR(4)  PMP_LOAD_ADDR(5)  PMP_LOAD_ADDR(6)  PMP_LOAD_ADDR(7)
+	PMP_LOAD_ADDR(8)  PMP_LOAD_ADDR(9)  PMP_LOAD_ADDR(10) PMP_LOAD_ADDR(11)
+	PMP_LOAD_ADDR(12) PMP_LOAD_ADDR(13) PMP_LOAD_ADDR(14) PMP_LOAD_ADDR(15)
+	PMP_LOAD_CFG(0)   PMP_LOAD_CFG(1)   PMP_LOAD_CFG(2)   PMP_LOAD_CFG(3)
+}
+
+}
@@ -0,0 +1,116 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "trace.hpp"
+#include "kernel.hpp"
+
+#include <atomic>
+
+
+
+namespace kernel::trace {
+
+// Trace ring buffer for a single hart.
+// Only the owning hart writes to it, so claiming a slot is the only atomic operation.
+struct ring_t {
+	// Total number of events ever recorded.
+	std::atomic<uint32_t> head;
+	// Circular buffer of events.
+	entry_t entries[KTRACE_SIZE];
+};
+
+static_assert((KTRACE_SIZE & (KTRACE_SIZE - 1)) == 0, "KTRACE_SIZE must be a power of two");
+
+// Trace buffers for all harts.
+static ring_t rings[KTRACE_HARTS];
+
+// Whether tracing is currently enabled.
+volatile bool enabled = false;
+
+// Get the index of the current hart.
+static inline int currentHart() {
+	long mhartid;
+	asm ("csrr %0, mhartid" : "=r" (mhartid));
+	return mhartid;
+}
+
+// Enable or disable tracing at runtime.
+void setEnabled(bool enable) {
+	enabled = enable;
+}
+
+// Discard all recorded trace events.
+void clear() {
+	for (size_t i = 0; i < KTRACE_HARTS; i++) {
+		rings[i].head.store(0, std::memory_order_relaxed);
+	}
+}
+
+// Append an event to the trace buffer of the current hart.
+KERNEL_IRAM void record(event_t type, int pid, uint32_t arg, uint64_t start, uint64_t end, uint32_t retval) {
+	if (!enabled) return;
+	int hart = currentHart();
+	if (hart < 0 || hart >= KTRACE_HARTS) return;
+	ring_t &ring = rings[hart];
+	
+	// Claim a slot, overwriting the oldest event if full.
+	uint32_t index = ring.head.fetch_add(1, std::memory_order_relaxed);
+	entry_t &ent   = ring.entries[index & (KTRACE_SIZE - 1)];
+	ent.type       = type;
+	ent.hart       = hart;
+	ent.pid        = pid;
+	ent.arg        = arg;
+	ent.start      = start;
+	ent.end        = end;
+	ent.retval     = retval;
+	ent._reserved  = 0;
+	std::atomic_signal_fence(std::memory_order_release);
+}
+
+// Copy the trace buffer of a hart in chronological order.
+// Returns the number of entries written to `out`.
+size_t snapshot(int hart, entry_t *out, size_t cap) {
+	if (hart < 0 || hart >= KTRACE_HARTS) return 0;
+	ring_t &ring = rings[hart];
+	
+	// Determine the range of valid entries.
+	uint32_t head  = ring.head.load(std::memory_order_acquire);
+	uint32_t count = head < KTRACE_SIZE ? head : KTRACE_SIZE;
+	if (count > cap) count = cap;
+	
+	// Copy oldest to newest.
+	for (uint32_t i = 0; i < count; i++) {
+		out[i] = ring.entries[(head - count + i) & (KTRACE_SIZE - 1)];
+	}
+	return count;
+}
+
+// Get the number of events overwritten because the buffer of a hart was full.
+uint32_t getDropped(int hart) {
+	if (hart < 0 || hart >= KTRACE_HARTS) return 0;
+	uint32_t head = rings[hart].head.load(std::memory_order_relaxed);
+	return head > KTRACE_SIZE ? head - KTRACE_SIZE : 0;
+}
+
+}
@@ -0,0 +1,114 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef KTRACE_SIZE
+#define KTRACE_SIZE 512
+#endif
+
+#ifndef KTRACE_HARTS
+#define KTRACE_HARTS 2
+#endif
+
+namespace kernel::trace {
+
+// Types of trace event.
+enum event_t : uint8_t {
+	// ABI call made by a process.
+	EV_ABICALL,
+	// Process started running in U-mode.
+	EV_PROC_START,
+	// Process exited or was terminated.
+	EV_PROC_EXIT,
+	// Non-ECALL trap taken.
+	EV_TRAP,
+	// Active context changed.
+	EV_CTX_SWITCH,
+};
+
+// A single binary trace record.
+// WARNING: This layout is parsed by `tools/ktrace2json.py`!
+struct entry_t {
+	// Type of event.
+	event_t  type;
+	// Hart that recorded this event.
+	uint8_t  hart;
+	// Process ID, 0 for the kernel.
+	uint16_t pid;
+	// ABI index, trap cause or new PID, depending on type.
+	uint32_t arg;
+	// Cycle count at start of event.
+	uint64_t start;
+	// Cycle count at end of event, equal to `start` for instant events.
+	uint64_t end;
+	// Return value, exit code or trap address, depending on type.
+	uint32_t retval;
+	// Padding to a power of two.
+	uint32_t _reserved;
+};
+
+static_assert(sizeof(entry_t) == 32, "size of entry_t must be 32");
+
+// Read the cycle counter.
+// The ESP32-C6 has no `mcycle`; it counts cycles in its 32-bit machine performance counter (CSR 0x7e2),
+// which is extended to 64 bits here. Interrupts are held off so nested callers can't extend it twice.
+inline uint64_t cycles() {
+	static uint32_t hi, last;
+	uint32_t status, lo;
+	asm volatile ("csrrci %0, mstatus, 0x8" : "=r" (status));
+	asm volatile ("csrr %0, 0x7e2" : "=r" (lo));
+	if (lo < last) hi++;
+	last = lo;
+	uint64_t out = ((uint64_t) hi << 32) | lo;
+	asm volatile ("csrw mstatus, %0" :: "r" (status));
+	return out;
+}
+
+// Whether tracing is currently enabled.
+extern volatile bool enabled;
+
+// Enable or disable tracing at runtime.
+void setEnabled(bool enable);
+// Discard all recorded trace events.
+void clear();
+// Append an event to the trace buffer of the current hart.
+void record(event_t type, int pid, uint32_t arg, uint64_t start, uint64_t end, uint32_t retval);
+// Append an instantaneous event to the trace buffer of the current hart.
+static inline void instant(event_t type, int pid, uint32_t arg, uint32_t retval) {
+	if (!enabled) return;
+	uint64_t now = cycles();
+	record(type, pid, arg, now, now, retval);
+}
+
+// Copy the trace buffer of a hart in chronological order.
+// Returns the number of entries written to `out`.
+size_t snapshot(int hart, entry_t *out, size_t cap);
+// Get the number of events overwritten because the buffer of a hart was full.
+uint32_t getDropped(int hart);
+
+}
@@ -30,12 +30,17 @@
 #include <esp_timer.h>
 #include <esp_system.h>
 #include <esp_log.h>
+#include <esp_rom_sys.h>
+#include <esp_heap_caps.h>
+#include <soc/soc.h>
 static const char *TAG = "badgeabi";
 
 #include <malloc.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 extern "C" const char abiCallTemplate[];
 extern "C" const char abiCallTemplateEnd[];
 
@@ -44,6 +49,7 @@ namespace abi {
 static elf::SymMap cache;
 #ifdef CONFIG_BADGEABI_ENABLE_KERNEL
 static std::vector<fptr_t> abiTable;
+static std::vector<std::string> abiNames;
 #endif
 static std::unordered_map<int, Context> contextMap;
 static int nextPID = 1;
@@ -80,6 +86,28 @@ Context *getContext() {
 	return getContext(threadPID);
 }
 
+// Check that the calling process may access `[ptr, ptr+len)`.
+// Always true if not called on behalf of a sandboxed process.
+bool checkUserPtr(const void *ptr, size_t len, bool write) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	auto ctx = getContext();
+	return !ctx || ctx->validate((size_t) ptr, len, write);
+#else
+	return true;
+#endif
+}
+
+// Number of bytes the calling process may access from `ptr` to the end of its mapping.
+// SIZE_MAX if not called on behalf of a sandboxed process.
+size_t userSpan(const void *ptr, bool write) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	auto ctx = getContext();
+	return ctx ? ctx->accessible((size_t) ptr, write) : SIZE_MAX;
+#else
+	return SIZE_MAX;
+#endif
+}
+
 // Set the context for this thread.
 void setContext(int pid) {
 	threadPID = pid;
@@ -87,11 +115,14 @@ void setContext(int pid) {
 
 // Destroy an ABI context.
 bool deleteContext(Context &context) {
-	return contextMap.erase(context.getPID());
+	return deleteContext(context.getPID());
 }
 
 // Destroy an ABI context.
 bool deleteContext(int pid) {
+	gpio::releaseContext(pid);
+	display::releaseContext(pid);
+	draw::releaseContext(pid);
 	return contextMap.erase(pid);
 }
 
@@ -164,7 +195,7 @@ void Context::insertAvailable(MemMapped add) {
 // Map a new range of a minimum size.
 // Returns pointer on success, 0 otherwise.
 // The minimum provided alignment shall be `sizeof(size_t)`.
-size_t Context::map(size_t min_length, bool allow_write, bool allow_exec, size_t min_align) {
+size_t Context::map(size_t min_length, bool allow_write, bool allow_exec, size_t min_align, bool dma) {
 	// Enforce alignment is a power of two.
 	if (min_align & (min_align - 1) || !min_length) {
 		return 0;
@@ -180,7 +211,14 @@ size_t Context::map(size_t min_length, bool allow_write, bool allow_exec, size_t
 	
 	size_t base;
 	MemRange mem;
-	if (min_align <= sizeof(size_t)) {
+	if (dma) {
+		// DMA memory is only provided with the minimum alignment.
+		if (min_align > sizeof(size_t)) return 0;
+		mem  = dmaAllocator(min_length);
+		if (!mem.base) return 0;
+		base = mem.base;
+		
+	} else if (min_align <= sizeof(size_t)) {
 		// No need for additional alignment of output memory.
 		mem  = allocator(min_length, allow_write, allow_exec);
 		if (!mem.base) return 0;
@@ -201,8 +239,9 @@ size_t Context::map(size_t min_length, bool allow_write, bool allow_exec, size_t
 	size_t actual_i = actual.size();
 	actual.push_back(mem);
 	
-	// Used space.
-	mapped.push_back({{base, min_length}, actual_i});
+	// Used space, kept sorted by base address.
+	MemMapped entry = {{base, min_length}, actual_i, allow_write, allow_exec};
+	mapped.insert(std::upper_bound(mapped.begin(), mapped.end(), entry), entry);
 	
 	return base;
 }
@@ -211,10 +250,19 @@ size_t Context::map(size_t min_length, bool allow_write, bool allow_exec, size_t
 // Index is into mapped list.
 void Context::unmapIdx(size_t index) {
 	// Free the memory.
-	deallocator(actual[index]);
+	size_t actual_i = mapped[index].actual;
+	deallocator(actual[actual_i]);
 	// Remove it from the list.
-	actual.erase(actual.begin() + index);
+	actual.erase(actual.begin() + actual_i);
 	mapped.erase(mapped.begin() + index);
+	lastHit = 0;
+	
+	// Correct indices.
+	for (auto &map: mapped) {
+		if (map.actual > actual_i) {
+			map.actual --;
+		}
+	}
 	
 	/* // Move a block from mapped to available.
 	auto range = mapped[index];
@@ -259,17 +307,60 @@ void Context::unmapIdx(size_t index) {
 // Unmap a range of memory.
 bool Context::unmap(size_t base) {
 	// Locate matching range.
-	for (size_t i = 0; i < mapped.size(); i++) {
-		if (base == mapped[i].promise.base) {
-			// Match found.
-			unmapIdx(i);
-			return true;
-		}
+	ssize_t i = findMapped(base);
+	if (i >= 0 && base == mapped[i].promise.base) {
+		// Match found.
+		unmapIdx(i);
+		return true;
 	}
 	// Match not found.
 	return false;
 }
 
+// Find the index of the mapping with the highest base address not above `addr`.
+// Returns -1 if there is no such mapping.
+ssize_t Context::findMapped(size_t addr) const {
+	// Binary search the last mapping starting at or before `addr`.
+	size_t begin = 0, end = mapped.size();
+	while (begin < end) {
+		size_t midpoint = (begin + end) / 2;
+		if (mapped[midpoint].promise.base <= addr) {
+			// Go higher.
+			begin = midpoint + 1;
+		} else {
+			// Go lower.
+			end = midpoint;
+		}
+	}
+	return (ssize_t) begin - 1;
+}
+
+// Determine whether `[base, base+length)` lies within a single mapping.
+// If `write` is true, the mapping must also be writable.
+bool Context::validate(size_t base, size_t length, bool write) const {
+	size_t span = accessible(base, write);
+	return span && length <= span;
+}
+
+// Number of bytes from `base` to the end of the mapping containing it.
+// If `write` is true, the mapping must also be writable.
+// Returns 0 if there is no such mapping.
+size_t Context::accessible(size_t base, bool write) const {
+	// Try the last hit first; ABI calls tend to reuse the same buffers.
+	size_t index = lastHit;
+	if (index >= mapped.size() || !mapped[index].promise.contains(base)) {
+		ssize_t found = findMapped(base);
+		if (found < 0 || !mapped[found].promise.contains(base)) return 0;
+		index   = found;
+		lastHit = found;
+	}
+	
+	const MemMapped &map = mapped[index];
+	if (write && !map.allow_write) return 0;
+	return map.promise.base + map.promise.length - base;
+}
+
+
 
 
 // An overridable allocator used for Context.
@@ -281,6 +372,15 @@ MemRange allocator(size_t min_length, bool allow_write, bool allow_exec) {
 	return { (size_t) mem, min_length };
 }
 
+// An overridable allocator used for Context, for memory that DMA can access.
+// The minimum provided alignment shall be `sizeof(size_t)`.
+MemRange dmaAllocator(size_t min_length) __attribute__((weak));
+MemRange dmaAllocator(size_t min_length) {
+	void *mem = heap_caps_malloc(min_length, MALLOC_CAP_DMA);
+	ESP_LOGD(TAG, "dmaAllocator(%zu) = %p", min_length, mem);
+	return { (size_t) mem, min_length };
+}
+
 // An overridable allocator used for Context.
 void deallocator(MemRange range) __attribute__((weak));
 void deallocator(MemRange range) {
@@ -291,36 +391,145 @@ void deallocator(MemRange range) {
 
 
 #ifdef CONFIG_BADGEABI_ENABLE_KERNEL
-// Generates an ABI call wrapper function.
-static void *writeABIWrapper(int abiIndex) {
+// Stride of the ABI call wrappers in `wrapperTable`.
+// Must fit `abiCallTemplate` plus the index word and be a power of two.
+static constexpr size_t wrapperStride = 32;
+// Contiguous table of all ABI call wrappers.
+static uint8_t *wrapperTable;
+
+#if defined(CONFIG_BADGEABI_ENABLE_MPU) && defined(CONFIG_BADGEABI_DIRECT_PURE_CALLS)
+// Round a region length up to a power of two, so an aligned region takes one NAPOT entry.
+static constexpr size_t napotLength(size_t len) {
+	size_t out = 8;
+	while (out < len) out <<= 1;
+	return out;
+}
+// Firmware code that pure ABI functions are called in directly: the mask ROM and flash-mapped code.
+static const kernel::pmp_region_t pureCode[] = {
+	{ SOC_IROM_MASK_LOW, napotLength(SOC_IROM_MASK_HIGH - SOC_IROM_MASK_LOW), kernel::PMP_R | kernel::PMP_X },
+	{ SOC_IROM_LOW,      napotLength(SOC_IROM_HIGH - SOC_IROM_LOW),           kernel::PMP_R | kernel::PMP_X },
+};
+#endif
+
+// Generates the ABI call wrappers for the entire ABI TABLE in one allocation.
+static bool writeABIWrappers() {
+	size_t len   = abiCallTemplateEnd - abiCallTemplate;
+	size_t count = abiTable.size();
+	if (len + sizeof(uint32_t) > wrapperStride) {
+		ESP_LOGE(TAG, "ABI call template too large (%zu bytes)", len);
+		return false;
+	}
+	
 	// Allocate an memories.
-	size_t len = abiCallTemplateEnd - abiCallTemplate;
-	size_t cap = len + sizeof(int);
-	void  *mem = malloc(cap);
-	if (!mem) return nullptr;
+	wrapperTable = (uint8_t *) memalign(wrapperStride, count * wrapperStride);
+	if (!wrapperTable) return false;
+	memset(wrapperTable, 0, count * wrapperStride);
+	
+	for (size_t i = 0; i < count; i++) {
+		uint8_t *mem = wrapperTable + i * wrapperStride;
+		// Copy in the generic.
+		memcpy(mem, (const void *) abiCallTemplate, len);
+		// Copy in the INDEX WORD.
+		uint32_t index = i;
+		memcpy(mem + len, &index, sizeof(index));
+	}
 	
-	// Copy in the generic.
-	memcpy(mem, (const void *) abiCallTemplate, len);
-	// Copy in the INDEX WORD.
-	uint32_t *indexPtr = (uint32_t *) (len + (size_t) mem);
-	*indexPtr = abiIndex;
+	// Make the new code visible to instruction fetch.
+	asm volatile ("fence.i" ::: "memory");
+	ESP_LOGD(TAG, "Wrote %zu ABI call wrappers to %p", count, wrapperTable);
 	
 	// Done!
-	return mem;
+	return true;
 }
 #endif
 
+// Whether a pure ABI function at `addr` can be linked into apps without an ABI call wrapper.
+bool directlyCallable(size_t addr) {
+#if !defined(CONFIG_BADGEABI_ENABLE_KERNEL)
+	// Apps run in M-mode and nothing is wrapped.
+	return true;
+#elif defined(CONFIG_BADGEABI_ENABLE_MPU) && defined(CONFIG_BADGEABI_DIRECT_PURE_CALLS)
+	// Functions outside the granted code, such as ones placed in IRAM, keep their wrapper.
+	for (const auto &reg: pureCode) {
+		if (addr - reg.base < reg.length) return true;
+	}
+	return false;
+#elif defined(CONFIG_BADGEABI_DIRECT_PURE_CALLS)
+	return true;
+#else
+	return false;
+#endif
+}
+
 static void initCache() {
 	exportSymbolsUnwrapped(cache);
 	#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	TrustMap trust;
+	#ifdef CONFIG_BADGEABI_DIRECT_PURE_CALLS
+	exportTrust(trust);
+	#endif
+	std::vector<size_t *> wrapped;
 	for (auto &entry: cache) {
-		auto fptr = entry.second;
-		entry.second = (size_t) writeABIWrapper(abiTable.size());
-		abiTable.push_back((fptr_t) fptr);
+		// Pure functions are linked directly and run in U-mode.
+		auto iter = trust.find(entry.first);
+		if (iter != trust.end() && iter->second == Trust::PURE && directlyCallable(entry.second)) continue;
+		
+		wrapped.push_back(&entry.second);
+		abiTable.push_back((fptr_t) entry.second);
+		abiNames.push_back(entry.first);
+	}
+	
+	if (!writeABIWrappers()) {
+		ESP_LOGE(TAG, "Failed to generate ABI call wrappers");
+		abort();
+	}
+	for (size_t i = 0; i < wrapped.size(); i++) {
+		*wrapped[i] = (size_t) wrapperTable + i * wrapperStride;
 	}
 	#endif
 }
 
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+// Compute the PMP settings granting U-mode access to this context's memory.
+// Returns false if the mappings don't fit in the reserved PMP entries.
+bool Context::buildPMP(kernel::riscv_pmp_t &out) const {
+	std::vector<kernel::pmp_region_t> regions;
+	regions.reserve(mapped.size());
+	for (const auto &map: mapped) {
+		uint8_t perm = kernel::PMP_R;
+		if (map.allow_write) perm |= kernel::PMP_W;
+		if (map.allow_exec)  perm |= kernel::PMP_X;
+		regions.push_back({ map.promise.base, map.promise.length, perm });
+	}
+	
+	// The ABI call wrappers are shared by all processes.
+	if (!cache.size()) initCache();
+	regions.push_back({ (size_t) wrapperTable, abiTable.size() * wrapperStride, kernel::PMP_R | kernel::PMP_X });
+#ifdef CONFIG_BADGEABI_DIRECT_PURE_CALLS
+	// Pure ABI functions run in U-mode from the firmware's code.
+	regions.insert(regions.end(), std::begin(pureCode), std::end(pureCode));
+#endif
+	
+	return kernel::buildPMP(out, regions.data(), regions.size());
+}
+
+// Recompute and load the PMP settings of the calling process.
+// If they don't fit, all access is revoked so stale grants can't remain.
+bool updatePMP(Context *ctx) {
+	auto kctx = kernel::getCtx();
+	kernel::riscv_pmp_t pmp;
+	bool res = ctx->buildPMP(pmp);
+	if (!res) memset(&pmp, 0, sizeof(pmp));
+	
+	// Keep the task switch hook from loading a half-written copy.
+	kctx->u_pmp_valid = 0;
+	kctx->u_pmp       = pmp;
+	kctx->u_pmp_valid = 1;
+	kernel::loadPMP(pmp);
+	return res;
+}
+#endif
+
 // Exports ABI symbols into `map`.
 void exportSymbolsUnwrapped(elf::SymMap &map) {
 	gpio::exportSymbolsUnwrapped(map);
@@ -329,6 +538,14 @@ void exportSymbolsUnwrapped(elf::SymMap &map) {
 	math::exportSymbolsUnwrapped(map);
 	implicitops::exportSymbolsUnwrapped(map);
 	display::exportSymbolsUnwrapped(map);
+	draw::exportSymbolsUnwrapped(map);
+}
+
+// Exports trust classes of ABI symbols into `map`.
+void exportTrust(TrustMap &map) {
+	libc::exportTrust(map);
+	math::exportTrust(map);
+	implicitops::exportTrust(map);
 }
 
 
@@ -345,6 +562,70 @@ size_t getAbiTableSize() {
 	if (!cache.size()) initCache();
 	return abiTable.size();
 }
+
+// Get the symbol name of an ABI TABLE entry.
+// Returns nullptr if the index is out of range.
+const char *getAbiName(size_t index) {
+	if (!cache.size()) initCache();
+	if (index >= abiNames.size()) return nullptr;
+	return abiNames[index].c_str();
+}
+
+// Get the ABI TABLE index of an ABI call wrapper address.
+// Returns -1 if the address is not inside an ABI call wrapper.
+int getWrapperIndex(size_t addr) {
+	if (!cache.size()) initCache();
+	size_t base = (size_t) wrapperTable;
+	if (addr < base || addr >= base + abiTable.size() * wrapperStride) return -1;
+	return (addr - base) / wrapperStride;
+}
+
+// Get the ABI TABLE index of a symbol name.
+// Returns -1 if there is no such entry.
+int getAbiIndex(const char *name) {
+	if (!cache.size()) initCache();
+	for (size_t i = 0; i < abiNames.size(); i++) {
+		if (abiNames[i] == name) return i;
+	}
+	return -1;
+}
+
+// Write a little-endian word to `fd`.
+static bool dumpWord(FILE *fd, uint32_t word) {
+	return fwrite(&word, sizeof(word), 1, fd) == 1;
+}
+
+// Write the kernel trace buffers and ABI names to `fd` for `tools/ktrace2json.py`.
+// Returns success status.
+bool dumpTrace(FILE *fd) {
+	if (!cache.size()) initCache();
+	
+	// Header.
+	bool res = fwrite("KTRC", 4, 1, fd) == 1
+		&& dumpWord(fd, 1)
+		&& dumpWord(fd, esp_rom_get_cpu_ticks_per_us())
+		&& dumpWord(fd, KTRACE_HARTS)
+		&& dumpWord(fd, abiNames.size());
+	
+	// ABI names, so indices can be mapped back on the host.
+	for (const auto &name: abiNames) {
+		res = res && dumpWord(fd, name.size())
+			&& fwrite(name.data(), 1, name.size(), fd) == name.size();
+	}
+	if (!res) return false;
+	
+	// Trace buffers of every hart.
+	auto entries = new kernel::trace::entry_t[KTRACE_SIZE];
+	for (int hart = 0; res && hart < KTRACE_HARTS; hart++) {
+		size_t count = kernel::trace::snapshot(hart, entries, KTRACE_SIZE);
+		res = dumpWord(fd, kernel::trace::getDropped(hart))
+			&& dumpWord(fd, count)
+			&& fwrite(entries, sizeof(*entries), count, fd) == count;
+	}
+	delete[] entries;
+	
+	return res;
+}
 #endif
 
 // Exports ABI symbols into `map`.
@@ -30,6 +30,7 @@
 #include <relocation.hpp>
 #ifdef CONFIG_BADGEABI_ENABLE_KERNEL
 #include <kernel.hpp>
+#include <trace.hpp>
 #endif
 
 #include <abi/gpio.hpp>
@@ -38,9 +39,12 @@
 #include <abi/math.hpp>
 #include <abi/implicitops.hpp>
 #include <abi/display.hpp>
+#include <abi/draw.hpp>
+#include <abi/trust.hpp>
 
 #include <vector>
 #include <unordered_map>
+#include <sys/types.h>
 
 namespace abi {
 
@@ -76,6 +80,10 @@ struct MemMapped {
 	MemRange promise;
 	// Index of actual memory range (may be larger).
 	size_t actual;
+	// Whether the range is writable.
+	bool allow_write;
+	// Whether the range is executable.
+	bool allow_exec;
 	
 	// Overload comparison operator.
 	bool operator<(const MemMapped &other) const { return promise.base < other.promise.base; }
@@ -97,13 +105,15 @@ class Context {
 	protected:
 		// Actual allocated blocks of memory.
 		std::vector<MemRange> actual;
-		// List of dynamically allocated memory ranges.
+		// List of dynamically allocated memory ranges, sorted by base address.
 		std::vector<MemMapped> mapped;
 		/* // List of available ranges of memory.
 		std::vector<MemMapped> available; */
 		
 		// Process ID.
 		int pid;
+		// Index into mapped of the last successful `validate`.
+		mutable size_t lastHit = 0;
 		
 		// Merge touching entries of available ranges.
 		void mergeAvailable();
@@ -112,6 +122,9 @@ class Context {
 		// Actual implementation of unmap.
 		// Index is into mapped list.
 		void unmapIdx(size_t index);
+		// Find the index of the mapping with the highest base address not above `addr`.
+		// Returns -1 if there is no such mapping.
+		ssize_t findMapped(size_t addr) const;
 		
 		friend Context &newContext();
 		friend void deleteContext();
@@ -136,18 +149,37 @@ class Context {
 		// Map a new range of a minimum size.
 		// Returns pointer on success, 0 otherwise.
 		// The minimum provided alignment shall be `sizeof(size_t)`.
-		size_t map(size_t min_length, bool allow_write = true, bool allow_exec = false, size_t min_align = sizeof(size_t));
+		// If `dma` is true, the memory is allocated with `dmaAllocator` and `min_align` may not exceed the minimum.
+		size_t map(size_t min_length, bool allow_write = true, bool allow_exec = false, size_t min_align = sizeof(size_t), bool dma = false);
 		// Unmap a range of memory.
 		// Returns whether base was the base address of a valid range.
 		bool unmap(size_t base);
 		
+		// Determine whether `[base, base+length)` lies within a single mapping.
+		// If `write` is true, the mapping must also be writable.
+		// Runs in O(log n) in the number of mappings.
+		bool validate(size_t base, size_t length, bool write = false) const;
+		// Number of bytes from `base` to the end of the mapping containing it.
+		// If `write` is true, the mapping must also be writable.
+		// Returns 0 if there is no such mapping.
+		size_t accessible(size_t base, bool write = false) const;
+		
 		// Get process ID.
 		int getPID() const { return pid; }
+		
+		#ifdef CONFIG_BADGEABI_ENABLE_MPU
+		// Compute the PMP settings granting U-mode access to this context's memory.
+		// Returns false if the mappings don't fit in the reserved PMP entries.
+		bool buildPMP(kernel::riscv_pmp_t &out) const;
+		#endif
 };
 
 // An overridable allocator used for Context.
 // The minimum provided alignment shall be `sizeof(size_t)`.
 extern MemRange allocator(size_t min_length, bool allow_write, bool allow_exec);
+// An overridable allocator used for Context, for memory that DMA can access.
+// The minimum provided alignment shall be `sizeof(size_t)`.
+extern MemRange dmaAllocator(size_t min_length);
 // An overridable allocator used for Context.
 extern void deallocator(MemRange);
 
@@ -162,6 +194,17 @@ Context *getContext(int pid);
 Context *getContext();
 // Set the context for this thread.
 void setContext(int pid);
+// Check that the calling process may access `[ptr, ptr+len)`.
+// Always true if not called on behalf of a sandboxed process.
+bool checkUserPtr(const void *ptr, size_t len, bool write = false);
+// Number of bytes the calling process may access from `ptr` to the end of its mapping.
+// SIZE_MAX if not called on behalf of a sandboxed process.
+size_t userSpan(const void *ptr, bool write = false);
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+// Recompute and load the PMP settings of the calling process.
+// If they don't fit, all access is revoked so stale grants can't remain.
+bool updatePMP(Context *ctx);
+#endif
 // Destroy an ABI context.
 bool deleteContext(Context &context);
 // Destroy an ABI context.
@@ -172,11 +215,27 @@ bool deleteContext(int pid);
 fptr_t *getAbiTable();
 // Get the size of the ABI TABLE.
 size_t getAbiTableSize();
+// Get the symbol name of an ABI TABLE entry.
+// Returns nullptr if the index is out of range.
+const char *getAbiName(size_t index);
+// Get the ABI TABLE index of an ABI call wrapper address.
+// Returns -1 if the address is not inside an ABI call wrapper.
+int getWrapperIndex(size_t addr);
+// Get the ABI TABLE index of a symbol name.
+// Returns -1 if there is no such entry.
+int getAbiIndex(const char *name);
+// Write the kernel trace buffers and ABI names to `fd` for `tools/ktrace2json.py`.
+// Returns success status.
+bool dumpTrace(FILE *fd);
 #endif
 
 // Exports ABI symbols into `map` (with wrapper).
 void exportSymbols(elf::SymMap &map);
 // Exports ABI symbols into `map` (no wrapper).
 void exportSymbolsUnwrapped(elf::SymMap &map);
+// Exports trust classes of ABI symbols into `map`.
+void exportTrust(TrustMap &map);
+// Whether a pure ABI function at `addr` can be linked into apps without an ABI call wrapper.
+bool directlyCallable(size_t addr);
 
 }
@@ -23,7 +23,117 @@
 */
 
 #include "display.hpp"
+#include "pixfmt.hpp"
+#include "scene.hpp"
+#include "bufptr.hpp"
+#include <abi.hpp>
+#include <displayabi.h>
+#include <badgert.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+#include <driver/gpio.h>
+#include <esp_timer.h>
+
 #include <map>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+#include <limits.h>
+#include <string.h>
+
+// Number of operations that can be queued for a display's flush task.
+#define DISPLAY_QUEUE_DEPTH 2
+// Stack size in bytes of a display's flush task.
+#define DISPLAY_TASK_STACK 4096
+// Longest time in milliseconds to wait for the tearing effect pin.
+#define DISPLAY_VSYNC_TIMEOUT 50
+// Size in bytes of the buffer used to pack and convert rectangles.
+#define DISPLAY_SCRATCH 4096
+// Number of rows per band until the speed of a display has been measured.
+#define DISPLAY_BAND_MIN_ROWS 4
+// Time in microseconds that a display write pauses between bands, so tasks of any priority can run.
+#define DISPLAY_BAND_GAP_US 200
+// Longest burst in milliseconds that the bandwidth budget allows after being idle.
+#define DISPLAY_BUDGET_BURST 50
+// Size in pixels of the square regions whose partial refreshes are counted.
+#define DISPLAY_GHOST_CELL 32
+
+using abi::BUFPTR;
+
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+// Width in pixels of the blocks compared for damage tracking.
+#define DAMAGE_TILE_W 16
+// Height in pixels of the blocks compared for damage tracking.
+#define DAMAGE_TILE_H 8
+// Maximum number of rectangles sent per flush before sending the whole frame instead.
+#define DAMAGE_MAX_RECTS 16
+#endif
+
+// A rectangle in pixels.
+struct Rect {
+	int x, y, w, h;
+};
+
+// A display operation queued for the flush task.
+struct Job {
+	// Kind of operation.
+	enum Type {
+		WRITE, WRITE_PARTIAL, BEGIN, FLUSH, PRESENT, RENDER, REFRESH, STOP
+	} type;
+	// Fence released once `buf` is no longer needed.
+	uint32_t seq;
+	// Pixel data to write.
+	const void *buf;
+	size_t len;
+	// Area to write.
+	Rect rect;
+	// Process that submitted the operation, or 0 for the firmware.
+	int pid;
+	// Time in microseconds at which the operation was submitted.
+	int64_t time;
+};
+
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+// A process's surface on a composited display.
+struct Layer {
+	// Process that owns the layer.
+	int pid;
+	// Position and size on the display.
+	Rect r;
+	// Stacking order; higher is on top.
+	int z;
+	// Opacity from 0 (hidden) to 255 (opaque).
+	uint8_t alpha;
+	// Whether pixels equal to `key` are transparent.
+	bool keyed;
+	// Transparent colour, in the layer's pixel format.
+	uint32_t key;
+	// Pixels, or null while the layer bypasses compositing.
+	BUFPTR pixels;
+};
+
+// Get the intersection of two rectangles.
+static Rect intersect(Rect a, Rect b) {
+	int x0 = std::max(a.x, b.x), x1 = std::min(a.x + a.w, b.x + b.w);
+	int y0 = std::max(a.y, b.y), y1 = std::min(a.y + a.h, b.y + b.h);
+	return { x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0) };
+}
+
+// Blend two RGB565 pixels two channels at a time; `alpha` is 0 to 32.
+static inline uint32_t blend565(uint32_t fg, uint32_t bg, uint32_t alpha) {
+	uint32_t f = (fg | (fg << 16)) & 0x07e0f81f;
+	uint32_t b = (bg | (bg << 16)) & 0x07e0f81f;
+	uint32_t r = ((f * alpha + b * (32 - alpha)) >> 5) & 0x07e0f81f;
+	return (r | (r >> 16)) & 0xffff;
+}
+#endif
 
 // Simple struct with display update context.
 struct Display {
@@ -34,22 +144,1034 @@ struct Display {
 	// Display size in pixels.
 	int width, height;
 	
-	// Flush the display.
-	bool operator()(const void *buf, size_t len) const {
-		return func(buf, len, 0, 0, width, height, cookie);
-	}
-	// Flush the display.
-	bool operator()(const void *buf, size_t len, int x, int y, int w, int h) const {
-		// Bounds check.
-		if (x < 0 || y < 0
+	// Longest time in microseconds a single call to the write callback should take, or 0 for no limit.
+	uint32_t bandUs = CONFIG_BADGEABI_DISPLAY_BAND_US;
+	// Bytes per second the display may send, or 0 for no limit.
+	uint32_t budget = 0;
+	// Bytes that may be sent right now without exceeding the budget.
+	int64_t credit = 0;
+	// Time in microseconds at which `credit` was last updated.
+	int64_t creditTime = 0;
+	// Measured speed of the write callback in bytes per millisecond, or 0 if not measured yet.
+	uint32_t speed = 0;
+	
+	// How the panel shows written pixels.
+	display_refresh_t refreshModel = DISPLAY_REFRESH_NONE;
+	// Starts a refresh of the panel, or null if it doesn't need one.
+	display_refresh_func_t refreshFunc = nullptr;
+	// Time in milliseconds writes must pause before partial writes are refreshed.
+	int batchMs = 0;
+	// Number of partial refreshes of a region before it gets a full refresh, or 0 for no limit.
+	int ghostLimit = 0;
+	// Region written since the last refresh.
+	Rect unrefreshed{};
+	// Partial refreshes of every `DISPLAY_GHOST_CELL` square since its last full refresh.
+	std::vector<uint8_t> ghosts;
+	// Task that refreshes once writes pause, if any.
+	std::atomic<TaskHandle_t> refreshTask{nullptr};
+	// Tells `refreshTask` to exit.
+	std::atomic<bool> refreshStop{false};
+	
+	// Performance counters.
+	display_stats_t stats{};
+	// Time in microseconds at which the last frame was sent, or 0 if none.
+	int64_t lastFrame = 0;
+	
+	// Queue of the flush task, or null if writes are synchronous.
+	QueueHandle_t queue = nullptr;
+	// Fence of the last submitted write.
+	uint32_t submitted = 0;
+	// Fence of the last write whose buffer is no longer used.
+	std::atomic<uint32_t> released{0};
+	// Task blocked in `wait`, if any.
+	std::atomic<TaskHandle_t> waiter{nullptr};
+	// Tearing effect pin, or -1 if frames are not paced.
+	int tePin = -1;
+	// Given on every rising edge of the tearing effect pin.
+	SemaphoreHandle_t vsync = nullptr;
+	// Format expected by the write callback.
+	display_fmt_t nativeFmt = DISPLAY_FMT_RAW;
+	// Format written by apps.
+	display_fmt_t srcFmt = DISPLAY_FMT_RAW;
+	// Taken while running an operation, since layers can be changed while the flush task runs.
+	std::mutex mtx;
+	// Buffer used to pack and convert rectangles.
+	BUFPTR scratch;
+	// Retained scene, if any.
+	std::unique_ptr<abi::scene::Scene> scene;
+	// Buffer the scene is rendered into.
+	BUFPTR band;
+	// One-shot timer that ends the pause between bands.
+	esp_timer_handle_t gapTimer = nullptr;
+	// Given by `gapTimer`.
+	SemaphoreHandle_t gapSem = nullptr;
+	
+	// Process that mapped the framebuffer, or 0 if not mapped.
+	int fbPid = 0;
+	// Framebuffer shared with that process.
+	uint8_t *fb = nullptr;
+	// Distance in bytes between rows of the framebuffer.
+	size_t fbStride = 0;
+	// Format of the framebuffer.
+	display_fmt_t fbFmt = DISPLAY_FMT_RAW;
+	
+	// Whether a rectangle lies within the display.
+	bool inBounds(int x, int y, int w, int h) const {
+		return !(x < 0 || y < 0
 			|| x + w > width  || w > width  || w < 0
-			|| y + h > height || h > height || h < 0) {
+			|| y + h > height || h > height || h < 0);
+	}
+	
+	// Mark the buffer of write `seq` as no longer used.
+	void release(uint32_t seq) {
+		released.store(seq, std::memory_order_release);
+		TaskHandle_t task = waiter.load();
+		if (task) xTaskNotifyGive(task);
+	}
+	
+	// Wait until the buffer of write `seq` is no longer used.
+	// Returns false on timeout.
+	bool wait(uint32_t seq, int64_t timeout_us) {
+		int64_t deadline = esp_timer_get_time() + timeout_us;
+		waiter.store(xTaskGetCurrentTaskHandle());
+		bool res;
+		while (!(res = (int32_t) (released.load(std::memory_order_acquire) - seq) >= 0)) {
+			TickType_t ticks = portMAX_DELAY;
+			if (timeout_us >= 0) {
+				int64_t left = deadline - esp_timer_get_time();
+				if (left <= 0) break;
+				ticks = pdMS_TO_TICKS((left + 999) / 1000);
+			}
+			ulTaskNotifyTake(pdTRUE, ticks);
+		}
+		waiter.store(nullptr);
+		return res;
+	}
+	
+	// Whether pixels are converted before they are sent.
+	bool converting() const {
+		return srcFmt != DISPLAY_FMT_RAW && nativeFmt != DISPLAY_FMT_RAW && srcFmt != nativeFmt;
+	}
+	
+	// Call the write callback once, measuring how long it takes.
+	bool sendBand(const void *buf, size_t len, Rect r) {
+		int64_t start = esp_timer_get_time();
+		bool    res   = func(buf, len, r.x, r.y, r.w, r.h, cookie);
+		int64_t time  = esp_timer_get_time() - start;
+		stats.write_calls++;
+		stats.write_time_us += time;
+		stats.write_time_max_us = std::max<uint32_t>(stats.write_time_max_us, time);
+		stats.bytes_out += len;
+		if (time > 0) {
+			// Smooth the speed so one slow call doesn't shrink bands too much.
+			uint32_t sample = len * 1000 / time;
+			speed = speed ? (speed * 3 + sample) / 4 : sample;
+		}
+		return res;
+	}
+	
+	// Charge `len` sent bytes to the bandwidth budget.
+	// The credit goes negative when the budget is overdrawn; `run` sleeps it off without holding `mtx`.
+	void charge(size_t len) {
+		if (!budget) return;
+		int64_t now   = esp_timer_get_time();
+		int64_t burst = std::max<int64_t>(len, (int64_t) budget * DISPLAY_BUDGET_BURST / 1000);
+		credit     = std::min(burst, credit + (now - creditTime) * budget / 1000000);
+		creditTime = now;
+		credit    -= len;
+	}
+	
+	// Get the time in microseconds until the bandwidth budget is no longer overdrawn.
+	int64_t overdrawnUs() const {
+		if (!budget || credit >= 0) return 0;
+		int64_t owed = -credit - (esp_timer_get_time() - creditTime) * budget / 1000000;
+		return owed > 0 ? owed * 1000000 / budget : 0;
+	}
+	
+	// Block for `DISPLAY_BAND_GAP_US` between bands, so lower-priority tasks get the CPU even though `mtx` stays held.
+	// Sleeps for a tick instead if the timer can't be created.
+	void bandGap() {
+		if (!gapSem) gapSem = xSemaphoreCreateBinary();
+		if (gapSem && !gapTimer) {
+			esp_timer_create_args_t args = {};
+			args.callback = [](void *arg) { xSemaphoreGive((SemaphoreHandle_t) arg); };
+			args.arg      = gapSem;
+			args.name     = "display_gap";
+			if (esp_timer_create(&args, &gapTimer) != ESP_OK) gapTimer = nullptr;
+		}
+		if (gapTimer && esp_timer_start_once(gapTimer, DISPLAY_BAND_GAP_US) == ESP_OK) {
+			xSemaphoreTake(gapSem, portMAX_DELAY);
+		} else {
+			vTaskDelay(1);
+		}
+	}
+	
+	// Call the write callback, splitting the rectangle into bands of rows that each take at most `bandUs`.
+	// Between bands, the calling task blocks for `DISPLAY_BAND_GAP_US`.
+	// A ready task of any priority therefore waits for at most one band: `bandUs` of sending plus converting its rows.
+	bool callFunc(const void *buf, size_t len, Rect r) {
+		if (refreshFunc) {
+			// Remember to refresh this region of the panel.
+			if (unrefreshed.w) {
+				int x1 = std::max(unrefreshed.x + unrefreshed.w, r.x + r.w);
+				int y1 = std::max(unrefreshed.y + unrefreshed.h, r.y + r.h);
+				unrefreshed.x = std::min(unrefreshed.x, r.x);
+				unrefreshed.y = std::min(unrefreshed.y, r.y);
+				unrefreshed.w = x1 - unrefreshed.x;
+				unrefreshed.h = y1 - unrefreshed.y;
+			} else {
+				unrefreshed = r;
+			}
+		}
+		if (!bandUs || r.h <= 1 || len % r.h) {
+			charge(len);
+			return sendBand(buf, len, r);
+		}
+		size_t rowLen = len / r.h;
+		bool   res    = true;
+		for (int y = 0; y < r.h;) {
+			int rows = r.h;
+			if (bandUs) {
+				rows = speed ? (uint64_t) bandUs * speed / 1000 / rowLen : DISPLAY_BAND_MIN_ROWS;
+				rows = std::clamp(rows, 1, r.h - y);
+			}
+			charge(rows * rowLen);
+			if (y) bandGap();
+			res &= sendBand((const uint8_t *) buf + y * rowLen, rows * rowLen, { r.x, r.y + y, r.w, rows });
+			y += rows;
+		}
+		return res;
+	}
+	
+	// Refresh the region of the panel written since the last refresh, or the whole panel if `full` is set.
+	// Regions with too many partial refreshes get a full refresh to remove ghosting.
+	bool refresh(bool full) {
+		if (!refreshFunc || (!full && !unrefreshed.w)) return true;
+		Rect r = unrefreshed;
+		unrefreshed = {};
+		display_refresh_t mode = refreshModel;
+		if (full || refreshModel == DISPLAY_REFRESH_FULL) {
+			r    = { 0, 0, width, height };
+			mode = DISPLAY_REFRESH_FULL;
+		}
+		
+		int cols = (width + DISPLAY_GHOST_CELL - 1) / DISPLAY_GHOST_CELL;
+		if (ghosts.empty()) ghosts.assign(cols * ((height + DISPLAY_GHOST_CELL - 1) / DISPLAY_GHOST_CELL), 0);
+		int x0 = r.x / DISPLAY_GHOST_CELL, x1 = (r.x + r.w - 1) / DISPLAY_GHOST_CELL;
+		int y0 = r.y / DISPLAY_GHOST_CELL, y1 = (r.y + r.h - 1) / DISPLAY_GHOST_CELL;
+		for (int y = y0; ghostLimit && y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				if (ghosts[y * cols + x] >= ghostLimit) mode = DISPLAY_REFRESH_FULL;
+			}
+		}
+		for (int y = y0; y <= y1; y++) {
+			for (int x = x0; x <= x1; x++) {
+				uint8_t &count = ghosts[y * cols + x];
+				count = mode == DISPLAY_REFRESH_FULL ? 0 : std::min(count + 1, 255);
+			}
+		}
+		
+		if (mode == DISPLAY_REFRESH_FULL) {
+			stats.full_refreshes++;
+		} else {
+			stats.partial_refreshes++;
+		}
+		return refreshFunc(mode, r.x, r.y, r.w, r.h, cookie);
+	}
+	
+	// Update statistics after running an operation.
+	void record(const Job &job) {
+		int64_t now = esp_timer_get_time();
+		if (job.type == Job::WRITE_PARTIAL) {
+			stats.partial_writes++;
+		} else if (job.type == Job::WRITE || job.type == Job::FLUSH || job.type == Job::PRESENT || job.type == Job::RENDER) {
+			if (lastFrame) {
+				uint32_t interval = now - lastFrame;
+				if (!stats.frame_interval_min_us || interval < stats.frame_interval_min_us) stats.frame_interval_min_us = interval;
+				stats.frame_interval_max_us    = std::max(stats.frame_interval_max_us, interval);
+				stats.frame_interval_total_us += interval;
+			}
+			stats.frames++;
+			lastFrame = now;
+		} else {
+			return;
+		}
+		
+		// Bucket `i` holds latencies below `DISPLAY_STATS_BUCKET_US << i`.
+		int64_t latency = now - job.time;
+		int     bucket  = 0;
+		while (bucket < DISPLAY_STATS_BUCKETS - 1 && latency >= ((int64_t) DISPLAY_STATS_BUCKET_US << bucket)) {
+			bucket++;
+		}
+		stats.latency_hist[bucket]++;
+	}
+	
+	// Send a rectangle to the display, converting it if needed.
+	// `src` points at its top left pixel; rows are `rowLen` bytes long and `stride` bytes apart.
+	bool sendRect(const uint8_t *src, size_t stride, size_t rowLen, Rect r) {
+		bool convert = converting();
+		if (!convert && (stride == rowLen || r.h == 1)) {
+			// Rows are contiguous.
+			return callFunc(src, r.h * rowLen, r);
+		}
+		
+		// Pack or convert as many rows as fit in the scratch buffer at a time.
+		size_t outLen = convert ? abi::pixfmt::rowSize(nativeFmt, r.w) : rowLen;
+		if (!scratch) scratch.reset((uint8_t *) malloc(DISPLAY_SCRATCH));
+		if (!scratch || outLen > DISPLAY_SCRATCH) {
+			if (convert) return false;
+			// Send rows one by one instead.
+			bool res = true;
+			for (int i = 0; i < r.h; i++) {
+				res &= sendRect(src + i * stride, rowLen, rowLen, { r.x, r.y + i, r.w, 1 });
+			}
+			return res;
+		}
+		int  rows = DISPLAY_SCRATCH / outLen;
+		bool res  = true;
+		for (int y = r.y; y < r.y + r.h; y += rows) {
+			int h = std::min(rows, r.y + r.h - y);
+			for (int i = 0; i < h; i++) {
+				auto row = src + (y - r.y + i) * stride;
+				if (convert) {
+					abi::pixfmt::convertRow(scratch.get() + i * outLen, nativeFmt, row, srcFmt, r.w, r.x, y + i);
+				} else {
+					memcpy(scratch.get() + i * outLen, row, rowLen);
+				}
+			}
+			res &= callFunc(scratch.get(), h * outLen, { r.x, y, r.w, h });
+		}
+		return res;
+	}
+	
+	// Send a buffer written by an app to the display, converting it if needed.
+	bool sendBuf(const void *buf, size_t len, Rect r) {
+		if (!converting()) {
+			return callFunc(buf, len, r);
+		}
+		size_t rowLen = abi::pixfmt::rowSize(srcFmt, r.w);
+		if (len != rowLen * r.h) return false;
+		return sendRect((const uint8_t *) buf, rowLen, rowLen, r);
+	}
+	
+	// Wait for the start of the panel's refresh, if frames are paced.
+	void waitVsync() {
+		if (tePin < 0) return;
+		// Discard edges from before this frame was ready.
+		xSemaphoreTake(vsync, 0);
+		xSemaphoreTake(vsync, pdMS_TO_TICKS(DISPLAY_VSYNC_TIMEOUT));
+	}
+	
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+	// Bytes per pixel, 0 if not yet known or -1 if damage tracking is not possible.
+	int bpp = 0;
+	// Copy of the frame shown on the display, in the format written by apps.
+	BUFPTR shadow;
+	// Dirty flag of each tile.
+	std::vector<bool> dirty;
+	// Whether `shadow` matches what is on the display.
+	bool valid = false;
+	// Whether a frame is in progress, deferring partial writes until `flush`.
+	bool inFrame = false;
+	
+	// Number of tile columns.
+	int tilesX() const { return (width  + DAMAGE_TILE_W - 1) / DAMAGE_TILE_W; }
+	// Number of tile rows.
+	int tilesY() const { return (height + DAMAGE_TILE_H - 1) / DAMAGE_TILE_H; }
+	
+	// Try to set up damage tracking for a certain pixel size.
+	// Returns whether damage tracking is active.
+	bool track(size_t len, int w, int h) {
+		if (bpp < 0 || !w || !h) return false;
+		size_t pixels = (size_t) w * h;
+		if (bpp && len == pixels * bpp) return true;
+		valid = false;
+		if (w != width || h != height) {
+			// Pixel size is not yet known from a full write, or changed.
+			return false;
+		}
+		
+		// Full write with a new pixel size: allocate the shadow frame.
+		bpp = len / pixels;
+		shadow.reset((uint8_t *) malloc(len));
+		if (len % pixels || !bpp || !shadow) {
+			// Pixels aren't a whole number of bytes or out of memory.
+			bpp = -1;
+			shadow.reset();
+			return false;
+		}
+		dirty.assign(tilesX() * tilesY(), false);
+		return true;
+	}
+	
+	// Copy a rectangle into the shadow frame, marking tiles whose contents changed as dirty.
+	void write(const uint8_t *buf, Rect r) {
+		size_t stride = (size_t) width * bpp;
+		size_t rowLen = (size_t) r.w * bpp;
+		for (int y = r.y; y < r.y + r.h; y++, buf += rowLen) {
+			uint8_t *row = shadow.get() + y * stride + r.x * bpp;
+			if (!memcmp(row, buf, rowLen)) continue;
+			
+			// Compare tile by tile.
+			int ty = y / DAMAGE_TILE_H;
+			for (int x = r.x; x < r.x + r.w;) {
+				int next = std::min(r.x + r.w, (x / DAMAGE_TILE_W + 1) * DAMAGE_TILE_W);
+				size_t off = (x - r.x) * bpp, len = (next - x) * bpp;
+				if (memcmp(row + off, buf + off, len)) {
+					memcpy(row + off, buf + off, len);
+					dirty[ty * tilesX() + x / DAMAGE_TILE_W] = true;
+				}
+				x = next;
+			}
+		}
+	}
+	
+	// Coalesce dirty tiles into rectangles.
+	// Returns false if there are too many rectangles.
+	bool coalesce(std::vector<Rect> &out) {
+		int tx = tilesX(), ty = tilesY();
+		// Rectangles that may still grow downwards.
+		size_t open = 0;
+		for (int y = 0; y < ty; y++) {
+			size_t prevOpen = open;
+			open = out.size();
+			for (int x = 0; x < tx; x++) {
+				if (!dirty[y * tx + x]) continue;
+				// Find a run of dirty tiles; single clean tiles are merged into it.
+				int end = x + 1;
+				while (end < tx && (dirty[y * tx + end] || (end + 1 < tx && dirty[y * tx + end + 1]))) end++;
+				Rect r = { x * DAMAGE_TILE_W, y * DAMAGE_TILE_H, (end - x) * DAMAGE_TILE_W, DAMAGE_TILE_H };
+				x = end;
+				
+				// Extend a rectangle of the previous tile row with the same columns.
+				bool merged = false;
+				for (size_t i = prevOpen; i < open; i++) {
+					if (out[i].x == r.x && out[i].w == r.w && out[i].y + out[i].h == r.y) {
+						out[i].h += r.h;
+						out.push_back(out[i]);
+						out.erase(out.begin() + i);
+						open--;
+						merged = true;
+						break;
+					}
+				}
+				if (!merged) out.push_back(r);
+				if (out.size() > DAMAGE_MAX_RECTS) return false;
+			}
+		}
+		
+		// Clip to the display.
+		for (auto &r: out) {
+			r.w = std::min(r.w, width  - r.x);
+			r.h = std::min(r.h, height - r.y);
+		}
+		return true;
+	}
+	
+	// Send a rectangle of the shadow frame to the display.
+	bool send(Rect r) {
+		size_t stride = (size_t) width * bpp;
+		return sendRect(shadow.get() + r.y * stride + r.x * bpp, stride, r.w * bpp, r);
+	}
+	
+	// Send all dirty tiles to the display.
+	bool flush() {
+		inFrame = false;
+		std::vector<Rect> rects;
+		bool res = true;
+		if (std::find(dirty.begin(), dirty.end(), true) == dirty.end()) return true;
+		waitVsync();
+		if (coalesce(rects)) {
+			for (auto r: rects) res &= send(r);
+		} else {
+			res = send({ 0, 0, width, height });
+		}
+		dirty.assign(dirty.size(), false);
+		return res;
+	}
+	
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+	// Layers, sorted by `z`; empty if the display is not composited.
+	std::vector<Layer> layers;
+	// Regions that need to be composited again.
+	std::vector<Rect> pending;
+	// Buffer for compositing a row.
+	BUFPTR row;
+	// Process that last wrote to the display while it was not composited, or -1 if none.
+	int lastWriter = -1;
+	
+	// Get the format of layer pixels.
+	display_fmt_t layerFmt() const {
+		return srcFmt != DISPLAY_FMT_RAW ? srcFmt : nativeFmt;
+	}
+	
+	// Get the layer of a process, or null if it has none.
+	Layer *findLayer(int pid) {
+		for (auto &layer: layers) {
+			if (layer.pid == pid) return &layer;
+		}
+		return nullptr;
+	}
+	
+	// Whether a layer may bypass compositing because it is the only one visible and covers the display.
+	bool canBypass(const Layer &layer) const {
+		if (layer.alpha != 255 || layer.keyed || layer.r.x || layer.r.y || layer.r.w != width || layer.r.h != height) {
 			return false;
 		}
-		return func(buf, len, x, y, w, h, cookie);
+		for (auto &other: layers) {
+			if (&other != &layer && other.alpha) return false;
+		}
+		return true;
+	}
+	
+	// Mark a region as needing to be composited again.
+	void damage(Rect r) {
+		r = intersect(r, { 0, 0, width, height });
+		if (r.w && r.h) pending.push_back(r);
+	}
+	
+	// Give pixel buffers to layers that can no longer bypass compositing.
+	// Must be called before compositing.
+	bool allocLayers() {
+		size_t lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+		for (auto &layer: layers) {
+			if (layer.pixels || canBypass(layer)) continue;
+			size_t rowLen = layer.r.w * lbpp;
+			layer.pixels.reset((uint8_t *) calloc(layer.r.h, rowLen));
+			if (!layer.pixels) return false;
+			
+			// A bypassing layer was last drawn straight to the display.
+			const uint8_t *src = nullptr;
+			size_t stride = 0;
+			if (fbPid == layer.pid && fb) {
+				src = fb;
+				stride = fbStride;
+			} else if (valid && bpp == (int) lbpp) {
+				// Layers without pixels were full-screen when they were last drawn.
+				src = shadow.get();
+				stride = width * bpp;
+			}
+			for (int y = 0; src && y < layer.r.h; y++) {
+				memcpy(layer.pixels.get() + y * rowLen, src + y * stride, rowLen);
+			}
+		}
+		return true;
+	}
+	
+	// Drop pixel buffers of layers that can bypass compositing.
+	// Must be called after compositing, since the shadow frame then holds their pixels.
+	void freeLayers() {
+		for (auto &layer: layers) {
+			if (layer.pixels && canBypass(layer)) layer.pixels.reset();
+		}
+	}
+	
+	// Composite the layers on top of each other for one row segment.
+	void composeRow(uint8_t *out, int y, int x0, int w) {
+		int lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+		memset(out, 0, w * lbpp);
+		bool be = layerFmt() == DISPLAY_FMT_RGB565_BE;
+		bool is565 = be || layerFmt() == DISPLAY_FMT_RGB565_LE;
+		
+		for (auto &layer: layers) {
+			Rect seg = intersect({ x0, y, w, 1 }, layer.r);
+			if (!layer.alpha || !seg.w || !seg.h) continue;
+			uint8_t *dst = out + (seg.x - x0) * lbpp;
+			const uint8_t *src;
+			if (layer.pixels) {
+				src = layer.pixels.get() + ((y - layer.r.y) * layer.r.w + seg.x - layer.r.x) * lbpp;
+			} else {
+				// Bypassing layers are in the shadow frame.
+				src = shadow.get() + (y * width + seg.x) * lbpp;
+			}
+			
+			if (layer.alpha == 255 && !layer.keyed) {
+				memcpy(dst, src, seg.w * lbpp);
+				continue;
+			}
+			uint32_t alpha = (layer.alpha + 4) >> 3;
+			for (int i = 0; i < seg.w; i++, dst += lbpp, src += lbpp) {
+				if (layer.keyed && !memcmp(src, &layer.key, lbpp)) continue;
+				if (layer.alpha == 255) {
+					memcpy(dst, src, lbpp);
+				} else if (is565) {
+					uint32_t f = be ? (src[0] << 8) | src[1] : src[0] | (src[1] << 8);
+					uint32_t b = be ? (dst[0] << 8) | dst[1] : dst[0] | (dst[1] << 8);
+					uint32_t p = blend565(f, b, alpha);
+					dst[!be] = p >> 8;
+					dst[be]  = p;
+				} else {
+					// Each byte is a separate channel.
+					for (int c = 0; c < lbpp; c++) {
+						dst[c] = (src[c] * layer.alpha + dst[c] * (255 - layer.alpha)) / 255;
+					}
+				}
+			}
+		}
+	}
+	
+	// Composite all damaged regions into the shadow frame.
+	bool composite() {
+		int lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+		if (!lbpp || abi::pixfmt::packed(layerFmt())) return false;
+		if (bpp != lbpp) {
+			// Set up the shadow frame for the layer format.
+			if (!track((size_t) width * height * lbpp, width, height)) return false;
+		}
+		if (!row) row.reset((uint8_t *) malloc(width * lbpp));
+		if (!row) return false;
+		if (!valid) {
+			// The display contents are unknown, so send everything.
+			pending.assign(1, { 0, 0, width, height });
+		}
+		
+		for (auto r: pending) {
+			for (int y = r.y; y < r.y + r.h; y++) {
+				composeRow(row.get(), y, r.x, r.w);
+				write(row.get(), { r.x, y, r.w, 1 });
+			}
+		}
+		pending.clear();
+		if (!valid) {
+			dirty.assign(dirty.size(), true);
+			valid = true;
+		}
+		return true;
+	}
+	
+	// Composite and send damaged regions, unless a frame is in progress.
+	bool update() {
+		if (!composite()) return false;
+		return inFrame || flush();
+	}
+	
+	// Write to the layer of a process, creating a full-screen layer if it has none.
+	// `r` is relative to the layer.
+	// Returns 1 on success, 0 on failure or -1 if the write bypasses compositing.
+	int layerWrite(int pid, const uint8_t *src, size_t stride, Rect r) {
+		Layer *layer = findLayer(pid);
+		if (!layer) {
+			layer = addLayer(pid, { 0, 0, width, height }, 0, false);
+			if (!layer || !allocLayers()) return 0;
+		}
+		if (!layer->pixels) return -1;
+		if (r.x < 0 || r.y < 0 || r.w <= 0 || r.h <= 0 || r.x + r.w > layer->r.w || r.y + r.h > layer->r.h) {
+			return 0;
+		}
+		
+		size_t lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+		for (int y = 0; y < r.h; y++) {
+			memcpy(layer->pixels.get() + ((r.y + y) * layer->r.w + r.x) * lbpp, src + y * stride, r.w * lbpp);
+		}
+		damage({ layer->r.x + r.x, layer->r.y + r.y, r.w, r.h });
+		return update();
+	}
+	
+	// Add a layer for a process, keeping layers sorted.
+	// If `inherit` is set, the layer starts with what is on the display instead of black.
+	Layer *addLayer(int pid, Rect r, int z, bool inherit) {
+		BUFPTR pixels;
+		if (!inherit) {
+			pixels.reset((uint8_t *) calloc(r.h, r.w * abi::pixfmt::rowSize(layerFmt(), 1)));
+			if (!pixels) return nullptr;
+		}
+		auto iter = std::upper_bound(layers.begin(), layers.end(), z, [](int z, const Layer &l) { return z < l.z; });
+		iter = layers.insert(iter, Layer{ pid, r, z, 255, false, 0, std::move(pixels) });
+		damage(r);
+		return &*iter;
+	}
+	
+	// Composite again after changing layers.
+	bool relayer() {
+		if (!allocLayers()) return false;
+		bool res = update();
+		freeLayers();
+		return res;
+	}
+	
+	// Create, move or remove the layer of a process, then composite again.
+	// A layer with a zero width or height is removed.
+	bool setLayer(int pid, Rect r, int z) {
+		if (!abi::pixfmt::rowSize(layerFmt(), 1) || abi::pixfmt::packed(layerFmt())) return false;
+		bool first = layers.empty();
+		if (first && lastWriter >= 0 && lastWriter != pid && (!lastWriter || abi::getContext(lastWriter))) {
+			// Keep what the previous writer drew as its own layer.
+			addLayer(lastWriter, { 0, 0, width, height }, 0, true);
+		}
+		
+		Layer *layer = findLayer(pid);
+		if (!layer) {
+			// An app that was drawing by itself keeps its picture.
+			bool inherit = first && lastWriter == pid && r.x == 0 && r.y == 0 && r.w == width && r.h == height;
+			if (r.w && r.h && !addLayer(pid, r, z, inherit)) return false;
+			return relayer();
+		}
+		
+		Layer old = std::move(*layer);
+		layers.erase(layers.begin() + (layer - layers.data()));
+		damage(old.r);
+		if (r.w && r.h) {
+			bool keep = !old.pixels || (old.r.w == r.w && old.r.h == r.h);
+			layer = addLayer(pid, r, z, keep);
+			if (!layer) return false;
+			layer->alpha = old.alpha;
+			layer->keyed = old.keyed;
+			layer->key   = old.key;
+			if (keep) {
+				layer->pixels = std::move(old.pixels);
+			} else {
+				// Keep the part of the picture that still fits.
+				size_t lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+				int    w    = std::min(old.r.w, r.w);
+				for (int y = 0; y < std::min(old.r.h, r.h); y++) {
+					memcpy(layer->pixels.get() + y * r.w * lbpp, old.pixels.get() + y * old.r.w * lbpp, w * lbpp);
+				}
+			}
+		}
+		return relayer();
+	}
+	
+	// Set how the layer of a process is blended, then composite again.
+	bool setBlend(int pid, uint8_t alpha, bool keyed, uint32_t key) {
+		Layer *layer = findLayer(pid);
+		if (!layer) return false;
+		layer->alpha = alpha;
+		layer->keyed = keyed;
+		layer->key   = key;
+		damage(layer->r);
+		return relayer();
+	}
+	
+	// Remove all layers of a process, then composite again.
+	bool removeLayers(int pid) {
+		size_t count = layers.size();
+		for (size_t i = 0; i < layers.size();) {
+			if (layers[i].pid == pid) {
+				damage(layers[i].r);
+				layers.erase(layers.begin() + i);
+			} else {
+				i++;
+			}
+		}
+		if (lastWriter == pid) lastWriter = -1;
+		return count == layers.size() || relayer();
+	}
+#endif
+#endif
+	
+	// Draw the full area of the display.
+	// Releases fence `seq` once `buf` is no longer needed.
+	bool operator()(const void *buf, size_t len, uint32_t seq) {
+		stats.bytes_in += len;
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+		if (track(len, width, height)) {
+			if (valid) {
+				// Only send what changed.
+				write((const uint8_t *) buf, { 0, 0, width, height });
+				release(seq);
+				return flush();
+			}
+			memcpy(shadow.get(), buf, len);
+			dirty.assign(dirty.size(), false);
+			valid = true;
+			release(seq);
+			
+			// Send from the shadow frame, since the buffer was released.
+			waitVsync();
+			return send({ 0, 0, width, height });
+		}
+#endif
+		waitVsync();
+		bool res = sendBuf(buf, len, { 0, 0, width, height });
+		release(seq);
+		return res;
+	}
+	// Draw a part of the display.
+	// Releases fence `seq` once `buf` is no longer needed.
+	bool operator()(const void *buf, size_t len, int x, int y, int w, int h, uint32_t seq) {
+		stats.bytes_in += len;
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+		if (valid && track(len, w, h)) {
+			// Only send what changed, possibly merged with other writes this frame.
+			write((const uint8_t *) buf, { x, y, w, h });
+			release(seq);
+			return inFrame || flush();
+		}
+#endif
+		bool res = sendBuf(buf, len, { x, y, w, h });
+		release(seq);
+		return res;
+	}
+	
+	// Send a rectangle of the framebuffer.
+	// Releases fence `seq` once it has been sent.
+	bool present(Rect r, uint32_t seq) {
+		waitVsync();
+		size_t rowLen = abi::pixfmt::rowSize(fbFmt, r.w);
+		bool   res    = sendRect(fb + r.y * fbStride + abi::pixfmt::rowSize(fbFmt, r.x), fbStride, rowLen, r);
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+		// The framebuffer bypasses the shadow frame.
+		valid = false;
+#endif
+		release(seq);
+		return res;
+	}
+	
+	// Render the scene of process `pid` band by band and send it.
+	bool render(int pid) {
+		if (!scene || scene->pid != pid) return false;
+		int  w = width, h = height;
+		bool composited = false;
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+		// Render into the process's layer instead.
+		if (!layers.empty()) {
+			Layer *layer = findLayer(pid);
+			w = layer ? layer->r.w : width;
+			h = layer ? layer->r.h : height;
+			composited = true;
+		} else {
+			lastWriter = pid;
+		}
+#endif
+		size_t rowLen = w * scene->bpp;
+		if (!band) band.reset((uint8_t *) malloc(DISPLAY_SCRATCH));
+		if (!band || rowLen > DISPLAY_SCRATCH) return false;
+		
+		int  rows = DISPLAY_SCRATCH / rowLen;
+		bool res  = true;
+		if (!composited) waitVsync();
+		for (int y = 0; y < h; y += rows) {
+			int  n    = std::min(rows, h - y);
+			Rect r    = { 0, y, w, n };
+			scene->render(band.get(), w, y, n);
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+			if (composited) {
+				int out = layerWrite(pid, band.get(), rowLen, r);
+				if (out < 0) {
+					// The compositor relies on the shadow frame, so go through it.
+					write(band.get(), r);
+					out = inFrame || flush();
+				}
+				res &= out;
+				continue;
+			}
+#endif
+			res &= sendRect(band.get(), rowLen, rowLen, r);
+		}
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+		// The scene bypasses the shadow frame.
+		if (!composited) valid = false;
+#endif
+		return res;
+	}
+	
+	// Start a frame.
+	void begin() {
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+		inFrame = true;
+#endif
+	}
+	// Send everything drawn since `begin`.
+	bool end() {
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+		if (inFrame && !layers.empty()) {
+			inFrame = false;
+			return update();
+		}
+#endif
+		if (inFrame && !valid) {
+			// Partial writes were sent right away.
+			inFrame = false;
+		} else if (inFrame) {
+			return flush();
+		}
+#endif
+		return true;
+	}
+	
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+	// Run a write or present on the layer of the process that submitted it.
+	// Returns 1 on success, 0 on failure or -1 if the write bypasses compositing.
+	int runLayer(const Job &job) {
+		if (layers.empty()) {
+			lastWriter = job.pid;
+			return -1;
+		}
+		size_t lbpp = abi::pixfmt::rowSize(layerFmt(), 1);
+		Rect   r    = job.rect;
+		int    res;
+		if (job.type == Job::PRESENT) {
+			res = layerWrite(job.pid, fb + r.y * fbStride + r.x * lbpp, fbStride, r);
+			if (res < 0) {
+				// Presenting directly would make the shadow frame stale, which the compositor relies on.
+				for (int y = 0; y < r.h; y++) {
+					write(fb + (r.y + y) * fbStride + r.x * lbpp, { r.x, r.y + y, r.w, 1 });
+				}
+				res = inFrame || flush();
+			}
+		} else {
+			if (job.type == Job::WRITE) {
+				Layer *layer = findLayer(job.pid);
+				r = { 0, 0, layer ? layer->r.w : width, layer ? layer->r.h : height };
+			}
+			if (job.len != r.w * r.h * lbpp) {
+				release(job.seq);
+				return 0;
+			}
+			stats.bytes_in += job.len;
+			res = layerWrite(job.pid, (const uint8_t *) job.buf, r.w * lbpp, r);
+		}
+		if (res >= 0) release(job.seq);
+		return res;
+	}
+#endif
+	
+	// Run an operation without updating statistics.
+	bool exec(const Job &job) {
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+		if (job.type == Job::WRITE || job.type == Job::WRITE_PARTIAL || job.type == Job::PRESENT) {
+			int res = runLayer(job);
+			if (res >= 0) return res;
+		}
+#endif
+		switch (job.type) {
+			case Job::WRITE:
+				return (*this)(job.buf, job.len, job.seq);
+			case Job::WRITE_PARTIAL:
+				return (*this)(job.buf, job.len, job.rect.x, job.rect.y, job.rect.w, job.rect.h, job.seq);
+			case Job::BEGIN:
+				begin();
+				return true;
+			case Job::FLUSH:
+				return end();
+			case Job::PRESENT:
+				return present(job.rect, job.seq);
+			case Job::RENDER:
+				return render(job.pid);
+			case Job::REFRESH:
+				return refresh(job.len);
+			default:
+				return false;
+		}
+	}
+	
+	// Run an operation, either right away or from the flush task.
+	bool run(const Job &job) {
+		bool    res;
+		int64_t owedUs;
+		{
+			std::lock_guard lock(mtx);
+			res = exec(job);
+			record(job);
+			if (refreshFunc && unrefreshed.w) {
+				TaskHandle_t task = refreshTask;
+				if (task && (job.type == Job::WRITE_PARTIAL || job.type == Job::PRESENT)) {
+					// Wait for writes to pause.
+					xTaskNotifyGive(task);
+				} else {
+					res &= refresh(false);
+				}
+			}
+			owedUs = overdrawnUs();
+		}
+		// Sleep off an overdrawn bandwidth budget without blocking other users of the display.
+		if (owedUs > 0) vTaskDelay(std::max<TickType_t>(1, pdMS_TO_TICKS((owedUs + 999) / 1000)));
+		return res;
+	}
+	
+	// Run an operation from the app, queueing it if writes are asynchronous.
+	bool submit(Job job) {
+		if (job.type == Job::WRITE || job.type == Job::WRITE_PARTIAL || job.type == Job::PRESENT || job.type == Job::STOP) {
+			job.seq = ++submitted;
+		}
+		auto ctx = abi::getContext();
+		job.pid  = ctx ? ctx->getPID() : 0;
+		job.time = esp_timer_get_time();
+		if (!queue) return run(job);
+		return xQueueSend(queue, &job, portMAX_DELAY) == pdTRUE;
 	}
 };
 
+// Flush task of an asynchronous display.
+static void flushTask(void *arg) {
+	auto &disp = *(Display *) arg;
+	Job job;
+	while (xQueueReceive(disp.queue, &job, portMAX_DELAY) == pdTRUE && job.type != Job::STOP) {
+		disp.run(job);
+	}
+	// The display may be deleted right after this.
+	disp.release(job.seq);
+	vTaskDelete(NULL);
+}
+
+// Refresh task of a display that batches partial refreshes.
+static void refreshTask(void *arg) {
+	auto &disp = *(Display *) arg;
+	TickType_t batch = std::max<TickType_t>(1, pdMS_TO_TICKS(disp.batchMs));
+	while (!disp.refreshStop) {
+		// Wait for a write, then until no write came in for `batch`.
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		while (!disp.refreshStop && ulTaskNotifyTake(pdTRUE, batch));
+		if (disp.refreshStop) break;
+		std::lock_guard lock(disp.mtx);
+		disp.refresh(false);
+	}
+	// The display may be deleted right after this.
+	disp.refreshTask = nullptr;
+	vTaskDelete(NULL);
+}
+
+// Tearing effect pin ISR.
+static void vsyncISR(void *arg) {
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR((SemaphoreHandle_t) arg, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+// Stop the flush task of a display, if any.
+static void stopAsync(Display &disp) {
+	if (!disp.queue) return;
+	Job job = { Job::STOP };
+	disp.submit(job);
+	disp.wait(disp.submitted, -1);
+	vQueueDelete(disp.queue);
+	disp.queue = nullptr;
+}
+
+// Stop batching refreshes of a display.
+static void stopRefresh(Display &disp) {
+	TaskHandle_t task = disp.refreshTask;
+	if (!task) return;
+	disp.refreshStop = true;
+	xTaskNotifyGive(task);
+	while (disp.refreshTask) vTaskDelay(1);
+	disp.refreshStop = false;
+}
+
+// Stop pacing frames of a display.
+static void stopVsync(Display &disp) {
+	if (disp.tePin < 0) return;
+	gpio_set_intr_type((gpio_num_t) disp.tePin, GPIO_INTR_DISABLE);
+	gpio_isr_handler_remove((gpio_num_t) disp.tePin);
+	disp.tePin = -1;
+}
+
+// Release the framebuffer of a display.
+// Its memory is unmapped from `ctx` if not null.
+static void unmapFB(Display &disp, abi::Context *ctx) {
+	// The flush task may still be reading it.
+	disp.wait(disp.submitted, -1);
+	if (ctx) {
+		ctx->unmap((size_t) disp.fb);
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+		abi::updatePMP(ctx);
+#endif
+	}
+	disp.fbPid = 0;
+	disp.fb    = nullptr;
+}
+
 // Stores the display contexts.
 static std::map<int, Display> displays;
 // Last added display's ID.
@@ -64,7 +1186,11 @@ int display_add(display_write_func_t func, void *cookie, int width, int height)
 	
 	// Emplace in the map.
 	int id = ++lastID;
-	displays[id] = Display{ func, cookie, width, height };
+	auto &disp  = displays[id];
+	disp.func   = func;
+	disp.cookie = cookie;
+	disp.width  = width;
+	disp.height = height;
 	return id;
 }
 // Remove a display.
@@ -72,6 +1198,14 @@ int display_add(display_write_func_t func, void *cookie, int width, int height)
 bool display_remove(int display) {
 	auto iter = displays.find(display);
 	if (iter != displays.end()) {
+		stopAsync(iter->second);
+		stopRefresh(iter->second);
+		stopVsync(iter->second);
+		// The memory stays mapped in the process until it exits.
+		if (iter->second.fb) unmapFB(iter->second, nullptr);
+		if (iter->second.vsync) vSemaphoreDelete(iter->second.vsync);
+		if (iter->second.gapTimer) esp_timer_delete(iter->second.gapTimer);
+		if (iter->second.gapSem) vSemaphoreDelete(iter->second.gapSem);
 		displays.erase(iter);
 		return true;
 	}
@@ -85,6 +1219,7 @@ int display_count() {
 // Get the IDs of connected displays.
 // Any ID zero means not present.
 void display_get_ids(int *out_ids, size_t len) {
+	if (len > SIZE_MAX / sizeof(int) || !abi::checkUserPtr(out_ids, len * sizeof(int), true)) return;
 	size_t i = 0;
 	for (auto iter = displays.begin(); i < len && iter != displays.end(); i++, iter++) {
 		out_ids[i] = iter->first;
@@ -113,21 +1248,524 @@ int display_height(int display) {
 
 // Draw the full area of a display.
 bool display_write(int display, const void *buf, size_t len) {
+	if (!abi::checkUserPtr(buf, len)) return false;
 	auto iter = displays.find(display);
 	if (iter != displays.end()) {
-		return iter->second(buf, len);
+		return iter->second.submit({ Job::WRITE, 0, buf, len });
 	}
 	return false;
 }
 // Draw a part of the display.
 bool display_write_partial(int display, const void *buf, size_t len, int x, int y, int width, int height) {
+	if (!abi::checkUserPtr(buf, len)) return false;
 	auto iter = displays.find(display);
-	if (iter != displays.end()) {
-		return iter->second(buf, len, x, y, width, height);
+	if (iter != displays.end() && iter->second.inBounds(x, y, width, height)) {
+		return iter->second.submit({ Job::WRITE_PARTIAL, 0, buf, len, { x, y, width, height } });
 	}
 	return false;
 }
 
+// Declare the format a display's write function expects.
+// Returns success status.
+bool display_set_native_format(int display, display_fmt_t fmt) {
+	auto iter = displays.find(display);
+	if (iter == displays.end() || (fmt != DISPLAY_FMT_RAW && !abi::pixfmt::rowSize(fmt, 1))) return false;
+	iter->second.nativeFmt = fmt;
+	return true;
+}
+// Declare the format of pixels written to a display.
+// Pixels are converted if it differs from the native format.
+// Returns false if the conversion is not supported.
+bool display_set_format(int display, display_fmt_t fmt) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	if (fmt != DISPLAY_FMT_RAW && disp.nativeFmt != DISPLAY_FMT_RAW && !abi::pixfmt::canConvert(fmt, disp.nativeFmt)) {
+		return false;
+	}
+	// The framebuffer's format is fixed while mapped.
+	if (disp.fb && fmt != disp.fbFmt) return false;
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+	// So are the formats of layers.
+	if (!disp.layers.empty() && fmt != disp.srcFmt) return false;
+#endif
+	// And that of the scene.
+	if (disp.scene && fmt != disp.srcFmt) return false;
+	disp.srcFmt = fmt;
+#ifdef CONFIG_BADGEABI_DISPLAY_DAMAGE
+	// Pixels in the shadow frame are in the old format.
+	disp.valid = false;
+#endif
+	return true;
+}
+
+// Map a DMA-capable framebuffer of a display into the calling process.
+// Its row stride in bytes and pixel format are stored in `stride` and `format`.
+// Draw into it and call `display_present` to send parts of it to the display.
+// Returns NULL on failure.
+void *display_map_fb(int display, size_t *stride, display_fmt_t *format) {
+	if (!abi::checkUserPtr(stride, sizeof(size_t), true) || !abi::checkUserPtr(format, sizeof(display_fmt_t), true)) {
+		return nullptr;
+	}
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx) return nullptr;
+	auto &disp = iter->second;
+	
+	if (!disp.fb) {
+		// The framebuffer is in the app's format, or the native format if that is not set.
+		display_fmt_t fmt = disp.srcFmt != DISPLAY_FMT_RAW ? disp.srcFmt : disp.nativeFmt;
+		size_t rowLen = abi::pixfmt::rowSize(fmt, disp.width);
+		if (!rowLen) return nullptr;
+		rowLen = (rowLen + 3) & ~3;
+		
+		size_t mem = ctx->map(rowLen * disp.height, true, false, sizeof(size_t), true);
+		if (!mem) return nullptr;
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+		if (!abi::updatePMP(ctx)) {
+			// Out of PMP entries.
+			ctx->unmap(mem);
+			abi::updatePMP(ctx);
+			return nullptr;
+		}
+#endif
+		disp.fbPid    = ctx->getPID();
+		disp.fb       = (uint8_t *) mem;
+		disp.fbStride = rowLen;
+		disp.fbFmt    = fmt;
+		
+	} else if (disp.fbPid != ctx->getPID()) {
+		// Mapped by another process.
+		return nullptr;
+	}
+	
+	*stride = disp.fbStride;
+	*format = disp.fbFmt;
+	return disp.fb;
+}
+// Unmap the framebuffer of a display from the calling process.
+// Returns success status.
+bool display_unmap_fb(int display) {
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx || !iter->second.fb || iter->second.fbPid != ctx->getPID()) return false;
+	unmapFB(iter->second, ctx);
+	return true;
+}
+// Send a rectangle of the mapped framebuffer to a display.
+// A width or height of 0 sends the whole framebuffer.
+// Use `display_wait` on `display_fence` before drawing into the sent area again.
+// Returns success status.
+bool display_present(int display, int x, int y, int width, int height) {
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx || !iter->second.fb || iter->second.fbPid != ctx->getPID()) return false;
+	auto &disp = iter->second;
+	if (!width || !height) {
+		x = y = 0;
+		width  = disp.width;
+		height = disp.height;
+	}
+	if (!disp.inBounds(x, y, width, height)) return false;
+	if (disp.fbFmt == DISPLAY_FMT_MONO) {
+		// Start on a byte boundary.
+		width += x & 7;
+		x     &= ~7;
+	} else if (disp.fbFmt == DISPLAY_FMT_GREY2) {
+		width += x & 3;
+		x     &= ~3;
+	}
+	return disp.submit({ Job::PRESENT, 0, nullptr, 0, { x, y, width, height } });
+}
+
+// Start a frame on a display.
+// Partial writes are merged and only sent when `display_flush` is called.
+bool display_begin(int display) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	return iter->second.submit({ Job::BEGIN });
+}
+// Send everything drawn since `display_begin` to a display.
+bool display_flush(int display) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	return iter->second.submit({ Job::FLUSH });
+}
+
+// Make writes to a display asynchronous.
+// Writes return right away and are sent by a separate task; use `display_wait`
+// before reusing a buffer passed to a write.
+// Returns success status.
+bool display_set_async(int display, bool async) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	if (!async) {
+		stopAsync(disp);
+		return true;
+	}
+	if (disp.queue) return true;
+	
+	disp.queue = xQueueCreate(DISPLAY_QUEUE_DEPTH, sizeof(Job));
+	if (!disp.queue) return false;
+	if (xTaskCreate(flushTask, "display", DISPLAY_TASK_STACK, &disp, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+		vQueueDelete(disp.queue);
+		disp.queue = nullptr;
+		return false;
+	}
+	return true;
+}
+// Get a fence for the last write to a display.
+// Returns 0 if the display does not exist.
+uint32_t display_fence(int display) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return 0;
+	return iter->second.submitted;
+}
+// Wait until the buffer passed to the write of `fence` is no longer used.
+// A negative timeout waits forever.
+// Returns false on timeout or if the display does not exist.
+bool display_wait(int display, uint32_t fence, int64_t timeout_us) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	return iter->second.wait(fence, timeout_us);
+}
+// Pace full frames of a display to the rising edge of its tearing effect pin.
+// A negative pin disables pacing.
+// Returns success status.
+bool display_set_vsync(int display, int te_pin) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	stopVsync(disp);
+	if (te_pin < 0) return true;
+	
+	if (!disp.vsync) disp.vsync = xSemaphoreCreateBinary();
+	if (!disp.vsync) return false;
+	// The firmware or GPIO ABI may already have installed it.
+	auto res = gpio_install_isr_service(0);
+	if (res && res != ESP_ERR_INVALID_STATE) return false;
+	if (gpio_set_direction((gpio_num_t) te_pin, GPIO_MODE_INPUT)
+		|| gpio_set_intr_type((gpio_num_t) te_pin, GPIO_INTR_POSEDGE)
+		|| gpio_isr_handler_add((gpio_num_t) te_pin, vsyncISR, disp.vsync)
+		|| gpio_intr_enable((gpio_num_t) te_pin)) {
+		gpio_set_intr_type((gpio_num_t) te_pin, GPIO_INTR_DISABLE);
+		gpio_isr_handler_remove((gpio_num_t) te_pin);
+		return false;
+	}
+	disp.tePin = te_pin;
+	return true;
+}
+
+// Declare how the panel of a display shows new pixels and the function that refreshes it, which gets the write function's cookie.
+// Written regions are refreshed together once writes pause for `batch_ms`, or right away after full writes and flushes;
+// a `batch_ms` of 0 refreshes after every write. Regions refreshed partially `ghost_limit` times get a full refresh.
+// Returns success status.
+bool display_set_refresh(int display, display_refresh_t model, display_refresh_func_t func, int batch_ms, int ghost_limit) {
+	auto iter = displays.find(display);
+	if (iter == displays.end() || (model != DISPLAY_REFRESH_NONE && !func) || ghost_limit < 0 || ghost_limit > 255) return false;
+	auto &disp = iter->second;
+	stopRefresh(disp);
+	{
+		std::lock_guard lock(disp.mtx);
+		// Show what was written under the old model first.
+		disp.refresh(false);
+		disp.refreshModel = model;
+		disp.refreshFunc  = model != DISPLAY_REFRESH_NONE ? func : nullptr;
+		disp.batchMs      = batch_ms;
+		disp.ghostLimit   = ghost_limit;
+		disp.ghosts.clear();
+	}
+	if (!disp.refreshFunc || batch_ms <= 0) return true;
+	
+	TaskHandle_t task;
+	if (xTaskCreate(refreshTask, "refresh", DISPLAY_TASK_STACK, &disp, uxTaskPriorityGet(NULL), &task) != pdPASS) {
+		return false;
+	}
+	disp.refreshTask = task;
+	return true;
+}
+// Refresh what was written to a display right away, or the whole panel with a full refresh if `full` is set.
+// Returns success status.
+bool display_refresh(int display, bool full) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	return iter->second.submit({ Job::REFRESH, 0, nullptr, full });
+}
+
+// Limit how long a display occupies its bus at a time and how much it may send.
+// Writes are split into bands of rows that each take at most `band_us` microseconds to send,
+// measured from earlier writes, and other tasks may use the bus between bands.
+// A `band_us` of 0 sends writes in one piece and a `bytes_per_sec` of 0 does not limit bandwidth.
+// Returns false if the display does not exist.
+bool display_set_schedule(int display, uint32_t band_us, uint32_t bytes_per_sec) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	std::lock_guard lock(disp.mtx);
+	disp.bandUs     = band_us;
+	disp.budget     = bytes_per_sec;
+	disp.credit     = 0;
+	disp.creditTime = esp_timer_get_time();
+	return true;
+}
+
+// Get the performance counters of a display, optionally resetting them afterwards.
+// Returns false if the display does not exist.
+bool display_stats(int display, display_stats_t *stats, bool reset) {
+	if (!abi::checkUserPtr(stats, sizeof(display_stats_t), true)) return false;
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	std::lock_guard lock(disp.mtx);
+	*stats = disp.stats;
+	if (reset) {
+		disp.stats     = {};
+		disp.lastFrame = 0;
+	}
+	return true;
+}
+
+// Get the performance counters of a display, optionally resetting them afterwards.
+// Returns false if the display does not exist.
+extern "C" bool badgert_display_stats(int display, display_stats_t *stats, bool reset) {
+	return display_stats(display, stats, reset);
+}
+
+
+
+// Get the process ID of the caller, or 0 for the firmware.
+static int callerPID() {
+	auto ctx = abi::getContext();
+	return ctx ? ctx->getPID() : 0;
+}
+
+// Get the scene of the calling process on a display, with the display locked.
+// Returns null if there is none.
+static abi::scene::Scene *ownScene(int display, std::unique_lock<std::mutex> &lock) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return nullptr;
+	lock = std::unique_lock(iter->second.mtx);
+	auto &scene = iter->second.scene;
+	return scene && scene->pid == callerPID() ? scene.get() : nullptr;
+}
+
+// Create a scene on a display for the calling process, replacing the previous one.
+// The runtime renders it band by band while sending, so the app needs no framebuffer.
+// `tiles` holds `tile_count` tiles of `tile_width` by `tile_height` pixels one after another,
+// in the format written to the display; it is copied.
+// The map is `cols` by `rows` tiles of `SCENE_TILE_NONE` and repeats in both directions.
+// Returns success status.
+bool scene_create(int display, const void *tiles, int tile_width, int tile_height, int tile_count, int cols, int rows) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	auto &disp = iter->second;
+	display_fmt_t fmt = disp.srcFmt != DISPLAY_FMT_RAW ? disp.srcFmt : disp.nativeFmt;
+	int bpp = abi::pixfmt::rowSize(fmt, 1);
+	if (!bpp || abi::pixfmt::packed(fmt)) return false;
+	if (tile_width <= 0 || tile_width > disp.width || tile_height <= 0 || tile_height > disp.height
+		|| tile_count < 0 || tile_count >= SCENE_TILE_NONE || cols <= 0 || rows <= 0 || cols > 0x10000 / rows
+		|| cols > INT_MAX / 2 / tile_width || rows > INT_MAX / 2 / tile_height) {
+		return false;
+	}
+	size_t tileSize = (size_t) tile_width * tile_height * bpp;
+	if ((size_t) tile_count > SIZE_MAX / tileSize) return false;
+	size_t size = tile_count * tileSize;
+	if (!abi::checkUserPtr(tiles, size)) return false;
+	
+	auto scene = std::make_unique<abi::scene::Scene>();
+	scene->pid       = callerPID();
+	scene->bpp       = bpp;
+	scene->tileW     = tile_width;
+	scene->tileH     = tile_height;
+	scene->tileCount = tile_count;
+	scene->cols      = cols;
+	scene->rows      = rows;
+	scene->tiles.reset((uint8_t *) malloc(size ? size : 1));
+	if (!scene->tiles) return false;
+	memcpy(scene->tiles.get(), tiles, size);
+	scene->map.assign(cols * rows, SCENE_TILE_NONE);
+	
+	std::lock_guard lock(disp.mtx);
+	if (disp.scene && disp.scene->pid != scene->pid) return false;
+	disp.scene = std::move(scene);
+	return true;
+}
+// Remove the calling process's scene from a display.
+// Returns success status.
+bool scene_destroy(int display) {
+	std::unique_lock<std::mutex> lock;
+	if (!ownScene(display, lock)) return false;
+	displays[display].scene = nullptr;
+	return true;
+}
+// Set the colour shown where no tile or sprite is drawn, as stored in memory.
+// Returns success status.
+bool scene_set_background(int display, uint32_t color) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	if (!scene) return false;
+	scene->background = color;
+	return true;
+}
+// Set a rectangle of `cols` by `rows` map entries starting at (`col`, `row`) to tile indices from `tiles`.
+// Returns success status.
+bool scene_set_tiles(int display, int col, int row, int cols, int rows, const uint16_t *tiles) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	if (!scene || col < 0 || row < 0 || cols < 0 || rows < 0 || cols > scene->cols - col || rows > scene->rows - row) {
+		return false;
+	}
+	if (!abi::checkUserPtr(tiles, (size_t) cols * rows * sizeof(uint16_t))) return false;
+	for (int i = 0; i < rows; i++) {
+		memcpy(&scene->map[(row + i) * scene->cols + col], tiles + i * cols, cols * sizeof(uint16_t));
+	}
+	return true;
+}
+// Set the map position in pixels shown at the top left of the display.
+// Returns success status.
+bool scene_scroll(int display, int x, int y) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	if (!scene) return false;
+	scene->scroll(x, y);
+	return true;
+}
+// Add a sprite with a copy of `pixels`, in the format written to the display; it starts hidden.
+// With `SCENE_SPRITE_COLORKEY`, pixels equal to `key` as stored in memory are transparent.
+// Returns the sprite's ID, or -1 on failure.
+int scene_sprite_add(int display, const void *pixels, int width, int height, uint32_t flags, uint32_t key) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	if (!scene || width <= 0 || height <= 0 || width > displays[display].width || height > displays[display].height) {
+		return -1;
+	}
+	size_t size = (size_t) width * height * scene->bpp;
+	if (!abi::checkUserPtr(pixels, size)) return -1;
+	BUFPTR copy((uint8_t *) malloc(size));
+	if (!copy) return -1;
+	memcpy(copy.get(), pixels, size);
+	
+	// New sprites go on top of others with the same `z`.
+	int id = ++scene->lastId;
+	auto iter = std::upper_bound(scene->sprites.begin(), scene->sprites.end(), 0, [](int z, const abi::scene::Sprite &s) { return z < s.z; });
+	scene->sprites.insert(iter, { id, std::move(copy), width, height, 0, 0, 0, false, (bool) (flags & SCENE_SPRITE_COLORKEY), key });
+	return id;
+}
+// Move a sprite and set its stacking order; higher `z` is on top.
+// Returns success status.
+bool scene_sprite_move(int display, int sprite, int x, int y, int z) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	auto spr   = scene ? scene->find(sprite) : nullptr;
+	if (!spr) return false;
+	// Positions further off the display look the same, and this keeps `x + width` from overflowing.
+	auto &disp = displays[display];
+	spr->x = std::clamp(x, -disp.width, disp.width);
+	spr->y = std::clamp(y, -disp.height, disp.height);
+	if (spr->z != z) {
+		// Move it to its new place in the stacking order.
+		auto moved = std::move(*spr);
+		moved.z = z;
+		scene->sprites.erase(scene->sprites.begin() + (spr - scene->sprites.data()));
+		auto iter = std::upper_bound(scene->sprites.begin(), scene->sprites.end(), z, [](int z, const abi::scene::Sprite &s) { return z < s.z; });
+		scene->sprites.insert(iter, std::move(moved));
+	}
+	return true;
+}
+// Show or hide a sprite.
+// Returns success status.
+bool scene_sprite_show(int display, int sprite, bool visible) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	auto spr   = scene ? scene->find(sprite) : nullptr;
+	if (!spr) return false;
+	spr->visible = visible;
+	return true;
+}
+// Remove a sprite.
+// Returns success status.
+bool scene_sprite_remove(int display, int sprite) {
+	std::unique_lock<std::mutex> lock;
+	auto scene = ownScene(display, lock);
+	auto spr   = scene ? scene->find(sprite) : nullptr;
+	if (!spr) return false;
+	scene->sprites.erase(scene->sprites.begin() + (spr - scene->sprites.data()));
+	return true;
+}
+// Render the scene and send it to the display.
+// Like other writes, this returns right away if the display is asynchronous.
+// Returns success status.
+bool scene_render(int display) {
+	auto iter = displays.find(display);
+	if (iter == displays.end()) return false;
+	return iter->second.submit({ Job::RENDER });
+}
+
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+// Create, move or resize the calling process's layer on a display.
+// Once a display has layers, writes from each process go to its own layer and
+// coordinates are relative to that layer; layers are drawn in increasing `z` order.
+// A width or height of 0 removes the layer.
+// Returns success status.
+bool display_layer(int display, int x, int y, int width, int height, int z) {
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx) return false;
+	auto &disp = iter->second;
+	if (width < 0 || height < 0 || width > disp.width || height > disp.height) return false;
+	std::lock_guard lock(disp.mtx);
+	return disp.setLayer(ctx->getPID(), { x, y, width, height }, z);
+}
+// Set the opacity of the calling process's layer on a display, and optionally a colour that is transparent.
+// The colour is in the display's pixel format, as stored in memory.
+// Returns success status.
+bool display_layer_blend(int display, uint8_t alpha, uint32_t flags, uint32_t key) {
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx) return false;
+	std::lock_guard lock(iter->second.mtx);
+	return iter->second.setBlend(ctx->getPID(), alpha, flags & DISPLAY_LAYER_COLORKEY, key);
+}
+// Remove the calling process's layer from a display.
+// Returns success status.
+bool display_layer_remove(int display) {
+	auto iter = displays.find(display);
+	auto ctx  = abi::getContext();
+	if (iter == displays.end() || !ctx) return false;
+	std::lock_guard lock(iter->second.mtx);
+	return iter->second.removeLayers(ctx->getPID());
+}
+#endif
+
+// Release all framebuffers, layers and scenes of process `pid`.
+void abi::display::releaseContext(int pid) {
+	for (auto &pair: displays) {
+		if (pair.second.fb && pair.second.fbPid == pid) unmapFB(pair.second, nullptr);
+		// Queued writes may still read from the process's memory.
+		if (pair.second.queue) pair.second.wait(pair.second.submitted, -1);
+		std::lock_guard lock(pair.second.mtx);
+		if (pair.second.scene && pair.second.scene->pid == pid) pair.second.scene = nullptr;
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+		pair.second.removeLayers(pid);
+#endif
+	}
+}
+
+// Prepare for process `pid` to unmap the memory at `base`.
+// Returns false if the memory must stay mapped.
+bool abi::display::releaseMemory(int pid, size_t base) {
+	for (auto &pair: displays) {
+		// Framebuffers are released with `display_unmap_fb`.
+		if (pair.second.fb && pair.second.fbPid == pid && (size_t) pair.second.fb == base) return false;
+	}
+	for (auto &pair: displays) {
+		// Queued writes may still read from the memory.
+		if (pair.second.queue) pair.second.wait(pair.second.submitted, -1);
+	}
+	return true;
+}
+
 void abi::display::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// From display.h:
 	map["display_add"]				= (size_t) &display_add;
@@ -138,4 +1776,34 @@ void abi::display::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["display_height"]			= (size_t) &display_height;
 	map["display_write"]			= (size_t) &display_write;
 	map["display_write_partial"]	= (size_t) &display_write_partial;
+	// From displayabi.h, except `display_set_native_format` and `display_set_refresh` which are firmware-only:
+	map["display_set_format"]		= (size_t) &display_set_format;
+	map["display_map_fb"]			= (size_t) &display_map_fb;
+	map["display_unmap_fb"]			= (size_t) &display_unmap_fb;
+	map["display_present"]			= (size_t) &display_present;
+	map["display_begin"]			= (size_t) &display_begin;
+	map["display_flush"]			= (size_t) &display_flush;
+	map["display_set_async"]		= (size_t) &display_set_async;
+	map["display_fence"]			= (size_t) &display_fence;
+	map["display_wait"]				= (size_t) &display_wait;
+	map["display_set_vsync"]		= (size_t) &display_set_vsync;
+	map["display_refresh"]			= (size_t) &display_refresh;
+	map["display_set_schedule"]		= (size_t) &display_set_schedule;
+	map["display_stats"]			= (size_t) &display_stats;
+	// From sceneabi.h:
+	map["scene_create"]				= (size_t) &scene_create;
+	map["scene_destroy"]			= (size_t) &scene_destroy;
+	map["scene_set_background"]		= (size_t) &scene_set_background;
+	map["scene_set_tiles"]			= (size_t) &scene_set_tiles;
+	map["scene_scroll"]				= (size_t) &scene_scroll;
+	map["scene_sprite_add"]			= (size_t) &scene_sprite_add;
+	map["scene_sprite_move"]		= (size_t) &scene_sprite_move;
+	map["scene_sprite_show"]		= (size_t) &scene_sprite_show;
+	map["scene_sprite_remove"]		= (size_t) &scene_sprite_remove;
+	map["scene_render"]				= (size_t) &scene_render;
+#ifdef CONFIG_BADGEABI_DISPLAY_COMPOSITOR
+	map["display_layer"]			= (size_t) &display_layer;
+	map["display_layer_blend"]		= (size_t) &display_layer_blend;
+	map["display_layer_remove"]		= (size_t) &display_layer_remove;
+#endif
 }
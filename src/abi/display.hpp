@@ -31,5 +31,10 @@ namespace abi::display {
 
 // Exports ABI symbols into `map` (no wrapper).
 void exportSymbolsUnwrapped(elf::SymMap &map);
+// Release all framebuffers mapped by process `pid`.
+void releaseContext(int pid);
+// Prepare for process `pid` to unmap the memory at `base`.
+// Returns false if the memory must stay mapped.
+bool releaseMemory(int pid, size_t base);
 
 }
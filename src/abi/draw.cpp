@@ -0,0 +1,451 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "draw.hpp"
+#include "pixfmt.hpp"
+#include "bufptr.hpp"
+#include <abi.hpp>
+#include <drawabi.h>
+
+#include <memory>
+#include <mutex>
+#include <algorithm>
+
+#include <string.h>
+
+// Number of bits of the glyph cache index.
+#define GLYPH_CACHE_BITS 6
+// Largest rendered glyph in bytes that is cached.
+#define GLYPH_CACHE_MAX  1024
+// Largest coordinate accepted by `draw_line`, which keeps its loop bounded.
+#define DRAW_LINE_MAX    32767
+
+using abi::BUFPTR;
+
+// A surface that has been checked for drawing on.
+struct Canvas {
+	// Surface in app memory, whose damage is updated.
+	draw_surface_t *surface;
+	// Top left pixel.
+	uint8_t *pixels;
+	// Distance in bytes between rows.
+	size_t stride;
+	// Size in pixels.
+	int width, height;
+	// Pixel format.
+	display_fmt_t fmt;
+	// Bytes per pixel, or 0 for `DISPLAY_FMT_MONO`.
+	int bpp;
+	
+	// Check a surface and its pixels.
+	// Returns false if it can't be drawn on.
+	bool open(const draw_surface_t *s, bool write) {
+		if (!abi::checkUserPtr(s, sizeof(draw_surface_t), write)) return false;
+		surface = (draw_surface_t *) s;
+		pixels  = (uint8_t *) s->pixels;
+		stride  = s->stride;
+		width   = s->width;
+		height  = s->height;
+		fmt     = s->format;
+		size_t rowLen = abi::pixfmt::rowSize(fmt, width);
+		if (width <= 0 || height <= 0 || !rowLen || stride < rowLen || stride > (SIZE_MAX - rowLen) / height) {
+			return false;
+		}
+		if (abi::pixfmt::packed(fmt) && fmt != DISPLAY_FMT_MONO) return false;
+		bpp = fmt == DISPLAY_FMT_MONO ? 0 : abi::pixfmt::rowSize(fmt, 1);
+		return abi::checkUserPtr(pixels, stride * (height - 1) + rowLen, write);
+	}
+	
+	// Clip a rectangle to the surface.
+	// Returns false if nothing is left.
+	bool clip(int &x, int &y, int &w, int &h) const {
+		if (x < 0) { w += x; x = 0; }
+		if (y < 0) { h += y; y = 0; }
+		w = std::min(w, width - x);
+		h = std::min(h, height - y);
+		return w > 0 && h > 0;
+	}
+	
+	// Add a rectangle to the damage of the surface.
+	void touch(int x, int y, int w, int h) {
+		auto &d = surface->damage;
+		if (d.width > 0 && d.height > 0) {
+			int x1 = std::max(d.x + d.width, x + w), y1 = std::max(d.y + d.height, y + h);
+			d.x      = std::min(d.x, x);
+			d.y      = std::min(d.y, y);
+			d.width  = x1 - d.x;
+			d.height = y1 - d.y;
+		} else {
+			d = { x, y, w, h };
+		}
+	}
+	
+	// Get the address of a pixel; not valid for `DISPLAY_FMT_MONO`.
+	uint8_t *at(int x, int y) const {
+		return pixels + y * stride + x * bpp;
+	}
+	
+	// Get a pixel of a `DISPLAY_FMT_MONO` surface.
+	bool bit(int x, int y) const {
+		return (pixels[y * stride + (x >> 3)] >> (7 - (x & 7))) & 1;
+	}
+	
+	// Set one pixel, which must lie within the surface.
+	void plot(int x, int y, uint32_t color) {
+		if (bpp) {
+			memcpy(at(x, y), &color, bpp);
+		} else if (color & 1) {
+			pixels[y * stride + (x >> 3)] |= 0x80 >> (x & 7);
+		} else {
+			pixels[y * stride + (x >> 3)] &= ~(0x80 >> (x & 7));
+		}
+	}
+	
+	// Fill part of a row, which must lie within the surface.
+	void span(int x, int y, int w, uint32_t color) {
+		if (!bpp) {
+			// Single pixels up to a byte boundary, then whole bytes.
+			int end = x + w;
+			for (; x < end && (x & 7); x++) plot(x, y, color);
+			int bytes = (end - x) >> 3;
+			memset(pixels + y * stride + (x >> 3), color & 1 ? 0xff : 0x00, bytes);
+			for (x += bytes * 8; x < end; x++) plot(x, y, color);
+			return;
+		}
+		// Double the filled part until the span is full.
+		uint8_t *p = at(x, y);
+		memcpy(p, &color, bpp);
+		for (int n = 1; n < w; n *= 2) {
+			memcpy(p + n * bpp, p, std::min(n, w - n) * bpp);
+		}
+	}
+};
+
+// A glyph rendered in a pixel format and colours.
+struct Glyph {
+	// Process that drew it.
+	int pid;
+	// Glyph bitmap in app memory, or null if the entry is free.
+	const uint8_t *bits;
+	// Size and row pitch of the bitmap.
+	int w, h, rowBytes;
+	// Format and colours it was rendered in.
+	display_fmt_t fmt;
+	uint32_t fg, bg;
+	// Rendered pixels, `width * height` without padding.
+	BUFPTR pixels;
+	// Size of `pixels` in bytes.
+	size_t cap;
+};
+
+// Rendered glyphs, indexed by a hash of the bitmap address and colours.
+static Glyph glyphCache[1 << GLYPH_CACHE_BITS];
+// Protects `glyphCache`.
+static std::mutex glyphMtx;
+
+// Get a glyph rendered for opaque text, rendering it if it is not in the cache.
+// Returns null if it is too large to cache.
+static const uint8_t *cachedGlyph(int pid, const uint8_t *bits, int rowBytes, int w, int h, display_fmt_t fmt, int bpp, uint32_t fg, uint32_t bg) {
+	size_t size = w * h * bpp;
+	if (size > GLYPH_CACHE_MAX) return nullptr;
+	uint32_t hash  = ((uint32_t) (size_t) bits ^ fg ^ (bg << 7) ^ pid) * 2654435761u;
+	Glyph   &glyph = glyphCache[hash >> (32 - GLYPH_CACHE_BITS)];
+	if (glyph.bits == bits && glyph.pid == pid && glyph.w == w && glyph.h == h && glyph.rowBytes == rowBytes
+		&& glyph.fmt == fmt && glyph.fg == fg && glyph.bg == bg) {
+		return glyph.pixels.get();
+	}
+	
+	glyph.bits = nullptr;
+	if (glyph.cap < size) {
+		glyph.pixels.reset((uint8_t *) malloc(size));
+		glyph.cap = glyph.pixels ? size : 0;
+		if (!glyph.pixels) return nullptr;
+	}
+	uint8_t *out = glyph.pixels.get();
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++, out += bpp) {
+			memcpy(out, (bits[y * rowBytes + (x >> 3)] << (x & 7)) & 0x80 ? &fg : &bg, bpp);
+		}
+	}
+	glyph.pid      = pid;
+	glyph.bits     = bits;
+	glyph.w        = w;
+	glyph.h        = h;
+	glyph.rowBytes = rowBytes;
+	glyph.fmt      = fmt;
+	glyph.fg       = fg;
+	glyph.bg       = bg;
+	return glyph.pixels.get();
+}
+
+// Draw one glyph with its top left corner at (`x`, `y`).
+static void drawGlyph(Canvas &c, int pid, const uint8_t *bits, int rowBytes, int gw, int gh, int x, int y, uint32_t fg, uint32_t bg, bool opaque) {
+	int cx = x, cy = y, w = gw, h = gh;
+	if (!c.clip(cx, cy, w, h)) return;
+	int ox = cx - x, oy = cy - y;
+	c.touch(cx, cy, w, h);
+	
+	if (opaque && c.bpp) {
+		const uint8_t *img = cachedGlyph(pid, bits, rowBytes, gw, gh, c.fmt, c.bpp, fg, bg);
+		if (img) {
+			for (int i = 0; i < h; i++) {
+				memcpy(c.at(cx, cy + i), img + ((oy + i) * gw + ox) * c.bpp, w * c.bpp);
+			}
+			return;
+		}
+	}
+	
+	// Fill runs of equal bits.
+	for (int i = 0; i < h; i++) {
+		const uint8_t *row = bits + (oy + i) * rowBytes;
+		for (int j = 0; j < w;) {
+			int  start = j;
+			bool on    = (row[(ox + j) >> 3] << ((ox + j) & 7)) & 0x80;
+			while (j < w && (bool) ((row[(ox + j) >> 3] << ((ox + j) & 7)) & 0x80) == on) j++;
+			if (on) {
+				c.span(cx + start, cy + i, j - start, fg);
+			} else if (opaque) {
+				c.span(cx + start, cy + i, j - start, bg);
+			}
+		}
+	}
+}
+
+
+
+// Get the pixel value of a colour in a format, as used by the drawing functions.
+// Colours are stored in memory as the first bytes of the value; `DISPLAY_FMT_MONO` uses 0 and 1.
+uint32_t draw_color(display_fmt_t format, uint8_t red, uint8_t green, uint8_t blue) {
+	uint32_t argb = 0xff000000 | (red << 16) | (green << 8) | blue;
+	switch (format) {
+		case DISPLAY_FMT_ARGB8888:
+			return argb;
+		case DISPLAY_FMT_RGB888:
+			return red | (green << 8) | (blue << 16);
+		case DISPLAY_FMT_MONO:
+			return (red * 77 + green * 150 + blue * 29) >= 128 * 256;
+		case DISPLAY_FMT_RGB565_BE:
+		case DISPLAY_FMT_RGB565_LE: {
+			uint32_t out = 0;
+			abi::pixfmt::convertRow(&out, format, &argb, DISPLAY_FMT_ARGB8888, 1, 0, 0);
+			return out;
+		}
+		default:
+			return 0;
+	}
+}
+
+// Fill a rectangle, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_fill_rect(draw_surface_t *surface, int x, int y, int width, int height, uint32_t color) {
+	Canvas c;
+	if (!c.open(surface, true)) return false;
+	if (!c.clip(x, y, width, height)) return true;
+	c.touch(x, y, width, height);
+	c.span(x, y, width, color);
+	for (int i = 1; i < height; i++) {
+		if (c.bpp) {
+			// Copy the first row.
+			memcpy(c.at(x, y + i), c.at(x, y), width * c.bpp);
+		} else {
+			c.span(x, y + i, width, color);
+		}
+	}
+	return true;
+}
+
+// Draw a horizontal line, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_hline(draw_surface_t *surface, int x, int y, int width, uint32_t color) {
+	return draw_fill_rect(surface, x, y, width, 1, color);
+}
+
+// Draw a vertical line, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_vline(draw_surface_t *surface, int x, int y, int height, uint32_t color) {
+	Canvas c;
+	int    width = 1;
+	if (!c.open(surface, true)) return false;
+	if (!c.clip(x, y, width, height)) return true;
+	c.touch(x, y, 1, height);
+	for (int i = 0; i < height; i++) {
+		c.plot(x, y + i, color);
+	}
+	return true;
+}
+
+// Draw a line between two points, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_line(draw_surface_t *surface, int x0, int y0, int x1, int y1, uint32_t color) {
+	if (y0 == y1) return draw_hline(surface, std::min(x0, x1), y0, abs(x1 - x0) + 1, color);
+	if (x0 == x1) return draw_vline(surface, x0, std::min(y0, y1), abs(y1 - y0) + 1, color);
+	Canvas c;
+	if (!c.open(surface, true)) return false;
+	if (std::max({ abs(x0), abs(y0), abs(x1), abs(y1) }) > DRAW_LINE_MAX) return false;
+	
+	int bx = std::min(x0, x1), by = std::min(y0, y1);
+	int bw = abs(x1 - x0) + 1, bh = abs(y1 - y0) + 1;
+	if (!c.clip(bx, by, bw, bh)) return true;
+	c.touch(bx, by, bw, bh);
+	
+	// Only check bounds per pixel if the line is partly outside.
+	bool inside = bw == abs(x1 - x0) + 1 && bh == abs(y1 - y0) + 1;
+	int  dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+	int  dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+	int  err = dx + dy;
+	while (true) {
+		if (inside || (x0 >= 0 && y0 >= 0 && x0 < c.width && y0 < c.height)) {
+			c.plot(x0, y0, color);
+		}
+		if (x0 == x1 && y0 == y1) break;
+		int e2 = 2 * err;
+		if (e2 >= dy) { err += dy; x0 += sx; }
+		if (e2 <= dx) { err += dx; y0 += sy; }
+	}
+	return true;
+}
+
+// Copy a rectangle of `src` at (`sx`, `sy`) to (`x`, `y`) on `dst`, clipped to both surfaces.
+// Pixels are converted if the formats differ, except with `DRAW_BLIT_COLORKEY`, where `key` is in the source format.
+// Returns false if a surface is invalid or the formats can't be converted.
+bool draw_blit(draw_surface_t *dst, int x, int y, const draw_surface_t *src, int sx, int sy, int width, int height, uint32_t flags, uint32_t key) {
+	Canvas d, s;
+	if (!d.open(dst, true) || !s.open(src, false)) return false;
+	bool keyed = flags & DRAW_BLIT_COLORKEY;
+	bool same  = s.fmt == d.fmt;
+	if (!same && (keyed || !abi::pixfmt::canConvert(s.fmt, d.fmt))) return false;
+	
+	// Clip to the source, then to the destination.
+	if (sx < 0) { x -= sx; width  += sx; sx = 0; }
+	if (sy < 0) { y -= sy; height += sy; sy = 0; }
+	width  = std::min(width,  s.width  - sx);
+	height = std::min(height, s.height - sy);
+	int cx = x, cy = y;
+	if (!d.clip(cx, cy, width, height)) return true;
+	sx += cx - x;
+	sy += cy - y;
+	x = cx;
+	y = cy;
+	
+	if (!same && ((s.fmt == DISPLAY_FMT_MONO && (sx & 7))
+		|| (d.fmt == DISPLAY_FMT_MONO && ((x & 7) || ((width & 7) && x + width != d.width))))) {
+		// Converted rows must start and end on byte boundaries.
+		return false;
+	}
+	d.touch(x, y, width, height);
+	
+	// Copy bottom-up if the rectangles may overlap the wrong way.
+	bool up = d.pixels == s.pixels && y > sy;
+	for (int n = 0; n < height; n++) {
+		int i = up ? height - 1 - n : n;
+		if (!same) {
+			size_t off = abi::pixfmt::rowSize(d.fmt, x);
+			abi::pixfmt::convertRow(d.pixels + (y + i) * d.stride + off, d.fmt, s.at(sx, sy + i), s.fmt, width, x, y + i);
+			
+		} else if (!d.bpp) {
+			// Whole bytes if both sides are aligned, otherwise single pixels.
+			int j = 0;
+			if (!keyed && !(x & 7) && !(sx & 7)) {
+				j = width & ~7;
+				memmove(d.pixels + (y + i) * d.stride + (x >> 3), s.pixels + (sy + i) * s.stride + (sx >> 3), j >> 3);
+			}
+			for (; j < width; j++) {
+				bool on = s.bit(sx + j, sy + i);
+				if (!keyed || on != (key & 1)) d.plot(x + j, y + i, on);
+			}
+			
+		} else if (!keyed) {
+			memmove(d.at(x, y + i), s.at(sx, sy + i), width * d.bpp);
+			
+		} else {
+			// Copy runs of pixels that are not the key colour.
+			const uint8_t *from = s.at(sx, sy + i);
+			uint8_t       *to   = d.at(x, y + i);
+			for (int j = 0; j < width;) {
+				while (j < width && !memcmp(from + j * s.bpp, &key, s.bpp)) j++;
+				int start = j;
+				while (j < width && memcmp(from + j * s.bpp, &key, s.bpp)) j++;
+				memmove(to + start * d.bpp, from + start * s.bpp, (j - start) * d.bpp);
+			}
+		}
+	}
+	return true;
+}
+
+// Draw `len` characters of text with its top left corner at (`x`, `y`), clipped to the surface.
+// A newline starts a new line below `x`; characters without a glyph are skipped.
+// Returns the horizontal position after the last character, or `x` if the surface or font is invalid.
+int draw_text(draw_surface_t *surface, const draw_font_t *font, int x, int y, const char *text, size_t len, uint32_t fg, uint32_t bg, uint32_t flags) {
+	Canvas c;
+	if (!c.open(surface, true) || !abi::checkUserPtr(font, sizeof(draw_font_t)) || !abi::checkUserPtr(text, len)) return x;
+	draw_font_t f = *font;
+	int    rowBytes  = (f.width + 7) / 8;
+	size_t glyphSize = rowBytes * f.height;
+	if (!f.width || !f.height || !abi::checkUserPtr(f.glyphs, glyphSize * f.count)) return x;
+	
+	bool opaque = flags & DRAW_TEXT_OPAQUE;
+	auto ctx    = abi::getContext();
+	int  pid    = ctx ? ctx->getPID() : 0;
+	std::unique_lock lock(glyphMtx, std::defer_lock);
+	if (opaque && c.bpp) lock.lock();
+	
+	int cx = x;
+	for (size_t i = 0; i < len; i++) {
+		uint8_t ch = text[i];
+		if (ch == '\n') {
+			cx  = x;
+			y  += f.height;
+			continue;
+		}
+		if (ch < f.first || ch - f.first >= f.count) continue;
+		drawGlyph(c, pid, f.glyphs + (ch - f.first) * glyphSize, rowBytes, f.width, f.height, cx, y, fg, bg, opaque);
+		cx += f.width;
+	}
+	return cx;
+}
+
+
+
+// Drop all glyphs cached for process `pid`.
+void abi::draw::releaseContext(int pid) {
+	std::lock_guard lock(glyphMtx);
+	for (auto &glyph: glyphCache) {
+		if (glyph.bits && glyph.pid == pid) {
+			glyph.bits = nullptr;
+			glyph.pixels.reset();
+			glyph.cap = 0;
+		}
+	}
+}
+
+void abi::draw::exportSymbolsUnwrapped(elf::SymMap &map) {
+	// From drawabi.h:
+	map["draw_color"]		= (size_t) &draw_color;
+	map["draw_fill_rect"]	= (size_t) &draw_fill_rect;
+	map["draw_hline"]		= (size_t) &draw_hline;
+	map["draw_vline"]		= (size_t) &draw_vline;
+	map["draw_line"]		= (size_t) &draw_line;
+	map["draw_blit"]		= (size_t) &draw_blit;
+	map["draw_text"]		= (size_t) &draw_text;
+}
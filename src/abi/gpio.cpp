@@ -23,10 +23,41 @@
 */
 
 #include "gpio.hpp"
+#include "bufptr.hpp"
 #include "badgesdk/include/gpio.h"
 
+#include <abi.hpp>
+#include <ioevent.h>
+#include <iomask.h>
+#include <i2cabi.h>
+#include <spiabi.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
 #include <driver/gpio.h>
 #include <driver/i2c.h>
+#include <driver/spi_master.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#include <esp_timer.h>
+#include <esp_log.h>
+static const char *TAG = "badgeabi";
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <unordered_map>
 
 // TODO: Support for MCUs other than ESP32-C6.
 
@@ -78,7 +109,309 @@ static uint32_t io_pin_cap_arr[] = {
 	/* 30 */ IO_CAP_COMMON,
 };
 
+// Get the mask of pins that have any of the capabilities in `cap`.
+static uint32_t io_cap_mask(uint32_t cap) {
+	uint32_t mask = 0;
+	for (size_t pin = 0; pin < sizeof(io_pin_cap_arr) / sizeof(*io_pin_cap_arr); pin++) {
+		if (io_pin_cap_arr[pin] & cap) mask |= 1lu << pin;
+	}
+	return mask;
+}
+
+// Pins that can be read or written by `io_read_mask` and `io_write_mask`.
+static const uint32_t io_input_mask  = io_cap_mask(IO_CAP_INPUT);
+static const uint32_t io_output_mask = io_cap_mask(IO_CAP_OUTPUT);
+
 static __thread i2c_cmd_handle_t host_cmd[2];
+// Device addressed by the command link of each interface.
+static __thread int host_addr[2];
+// User buffer queued on a command link; the driver only accesses it at `i2c_host_stop`.
+struct I2cHostBuf {
+	const void *ptr;
+	size_t      len;
+	bool        write;
+};
+// User buffers queued on the command link of each interface.
+static __thread std::vector<I2cHostBuf> *host_bufs[2];
+
+// Remember a user buffer queued on the command link of `interface`.
+static void i2c_host_track(int interface, const void *ptr, size_t len, bool write) {
+	if (!host_bufs[interface]) host_bufs[interface] = new std::vector<I2cHostBuf>();
+	host_bufs[interface]->push_back({ptr, len, write});
+}
+
+// Check again that the user buffers queued on `interface` are still mapped.
+static bool i2c_host_recheck(int interface) {
+	if (!host_bufs[interface]) return true;
+	for (const I2cHostBuf &buf: *host_bufs[interface]) {
+		if (!abi::checkUserPtr(buf.ptr, buf.len, buf.write)) return false;
+	}
+	return true;
+}
+
+// Time in milliseconds an I2C transaction may take.
+#define I2C_TIMEOUT CONFIG_BADGEABI_I2C_TIMEOUT_MS
+// Time in milliseconds an I2C transaction may wait for its interface.
+#define I2C_BUS_WAIT CONFIG_BADGEABI_I2C_BUS_WAIT_MS
+// Clock frequency of I2C devices that did not declare one.
+#define I2C_DEFAULT_SPEED 100000
+// Number of commands in a prepared I2C transaction, at most:
+// start, two address bytes, write, repeated start, two address bytes, read with and without ACK, stop.
+#define I2C_TXN_CMDS 10
+// Size in bytes of the command link of a prepared I2C transaction.
+// Like `I2C_LINK_RECOMMENDED_SIZE`, which counts whole transactions, it has room for the link's own header.
+#define I2C_TXN_LINK_SIZE ((I2C_TXN_CMDS + 2) * I2C_INTERNAL_STRUCT_SIZE)
+// Number of queued asynchronous transfers per interface and per process.
+#define I2C_QUEUE_DEPTH CONFIG_BADGEABI_I2C_QUEUE_DEPTH
+// Stack size of the I2C bus workers.
+#define I2C_TASK_STACK 2048
+
+// An I2C interface shared by processes and the firmware.
+// Hands the bus to one transaction at a time and switches the clock to suit each device.
+struct I2cBus {
+	// Protects the fields below; `cv` is signalled when the bus is released or a waiter gives up.
+	std::mutex              mtx;
+	std::condition_variable cv;
+	// Whether a transaction holds the bus, and of which process.
+	bool busy  = false;
+	int  owner = -1;
+	// Process that held the bus last.
+	int  last  = -1;
+	// Waiting transactions in order of arrival, as ticket and process.
+	std::deque<std::pair<uint32_t, int>> waiting;
+	// Next ticket to hand out.
+	uint32_t nextTicket = 0;
+	// Processes that called `i2c_host_init`.
+	std::vector<int> users;
+	// Clock frequency of devices that declared one, by process and address.
+	// Each process only affects its own transactions.
+	std::map<std::pair<int, int>, uint32_t> deviceSpeed;
+	
+	// Only used by the holder of the bus.
+	// Whether the driver was installed by `i2c_host_init`.
+	bool     installed = false;
+	// Pins the driver is set up with.
+	int      sda = -1, scl = -1;
+	// Current clock frequency, or 0 if the driver was set up elsewhere.
+	uint32_t speed = 0;
+	
+	// Get the ticket served next: the first waiter of a process other than the last holder, else the first waiter.
+	uint32_t nextServed() const {
+		for (auto &waiter: waiting) {
+			if (waiter.second != last) return waiter.first;
+		}
+		return waiting.front().first;
+	}
+	
+	// Wait at most I2C_BUS_WAIT milliseconds for the bus.
+	// Returns whether the bus is now held.
+	bool claim(int pid) {
+		std::unique_lock lock(mtx);
+		auto ticket   = std::make_pair(nextTicket++, pid);
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(I2C_BUS_WAIT);
+		waiting.push_back(ticket);
+		bool ok = cv.wait_until(lock, deadline, [&] { return !busy && nextServed() == ticket.first; });
+		waiting.erase(std::find(waiting.begin(), waiting.end(), ticket));
+		if (ok) {
+			busy  = true;
+			owner = pid;
+			last  = pid;
+		} else {
+			// Giving up may make another waiter next.
+			cv.notify_all();
+		}
+		return ok;
+	}
+	
+	// Release the bus after a successful `claim`.
+	void release() {
+		std::lock_guard lock(mtx);
+		busy = false;
+		cv.notify_all();
+	}
+	
+	// Forget a process, waiting for a transaction of it that may still be running.
+	void releaseContext(int pid) {
+		std::unique_lock lock(mtx);
+		cv.wait(lock, [&] { return !busy || owner != pid; });
+		users.erase(std::remove(users.begin(), users.end(), pid), users.end());
+		deviceSpeed.erase(deviceSpeed.lower_bound({ pid, INT_MIN }), deviceSpeed.upper_bound({ pid, INT_MAX }));
+	}
+	
+	// Get the clock frequency for process `pid` to address a device with.
+	uint32_t speedOf(int pid, int device) {
+		std::lock_guard lock(mtx);
+		auto iter = deviceSpeed.find({ pid, device });
+		return iter == deviceSpeed.end() ? I2C_DEFAULT_SPEED : iter->second;
+	}
+};
+
+// Shared state of each I2C interface.
+static I2cBus i2c_bus[2];
+
+// Holds an I2C interface for the duration of a scope, if it could be claimed.
+struct I2cHold {
+	I2cBus *bus;
+	bool    ok;
+	
+	I2cHold(int interface, int pid): bus(&i2c_bus[interface]), ok(bus->claim(pid)) {}
+	I2cHold(I2cHold const &) = delete;
+	~I2cHold() {
+		if (ok) bus->release();
+	}
+};
+
+// Set up the driver of an I2C interface as host; the caller holds the bus.
+static bool i2c_bus_config(int interface, int sda, int scl, uint32_t speed) {
+	i2c_config_t config = {
+		.mode = I2C_MODE_MASTER,
+		.sda_io_num = (gpio_num_t) sda,
+		.scl_io_num = (gpio_num_t) scl,
+		.sda_pullup_en = true,
+		.scl_pullup_en = true,
+		.master = { .clk_speed = speed },
+		.clk_flags = 0,
+	};
+	return i2c_param_config((i2c_port_t) interface, &config) == 0;
+}
+
+// Switch an I2C interface to the clock frequency process `pid` declared for a device; the caller holds the bus.
+static bool i2c_bus_select(int interface, int pid, int device) {
+	auto &bus = i2c_bus[interface];
+	if (!bus.speed) return true;
+	uint32_t speed = bus.speedOf(pid, device);
+	if (speed == bus.speed) return true;
+	if (!i2c_bus_config(interface, bus.sda, bus.scl, speed)) return false;
+	bus.speed = speed;
+	return true;
+}
+
+// A prepared I2C transaction.
+struct I2cTxn {
+	// Process that prepared it.
+	int pid;
+	// I2C interface it runs on.
+	int interface;
+	// Device it addresses.
+	int device;
+	// Command link, built in `link`.
+	i2c_cmd_handle_t cmd = nullptr;
+	// Storage for the command link.
+	uint8_t link[I2C_TXN_LINK_SIZE];
+	// Bytes written followed by bytes read; the command link points into this.
+	std::unique_ptr<uint8_t[]> data;
+	// Number of bytes written and read.
+	size_t writeLen, readLen;
+	
+	~I2cTxn() {
+		if (cmd) i2c_cmd_link_delete_static(cmd);
+	}
+};
+// Protects `i2c_txns`.
+static std::mutex i2c_txn_mtx;
+// Prepared I2C transactions; handles are indices plus one.
+static std::vector<std::shared_ptr<I2cTxn>> i2c_txns;
+
+// An asynchronous I2C transfer, queued to the bus worker of its interface.
+struct I2cRequest {
+	// Transfer ID.
+	int id;
+	// Process that submitted it.
+	int pid;
+	// Prepared transaction to run.
+	int txn;
+	// Number of bytes written and read, as the transaction was prepared when submitted.
+	size_t writeLen, readLen;
+	// Bytes to write followed by room for the bytes read, allocated with `malloc`.
+	uint8_t *data;
+	// Read buffer and cookie passed to `i2c_txn_submit`.
+	uint8_t *read_buf;
+	void    *cookie;
+};
+
+// A completed asynchronous I2C transfer.
+struct I2cDone {
+	// What is returned to the app.
+	i2c_done_t info;
+	// Bytes written followed by the bytes read.
+	abi::BUFPTR data;
+	// Number of bytes written and read.
+	size_t writeLen, readLen;
+	// Where the bytes read are copied once the app collects the transfer.
+	uint8_t *read_buf;
+};
+
+// Asynchronous I2C transfers of a process.
+struct I2cAsync {
+	// Task woken up when a transfer completes.
+	TaskHandle_t task = nullptr;
+	// IDs of transfers not yet completed.
+	std::vector<int> pending;
+	// Completed transfers not yet collected.
+	std::deque<I2cDone> done;
+};
+
+// Protects `i2c_async` and `i2c_queue`.
+static std::mutex i2c_async_mtx;
+// Asynchronous transfers per process.
+static std::unordered_map<int, I2cAsync> i2c_async;
+// Transfer queue of each interface's bus worker, created with the first transfer.
+static QueueHandle_t i2c_queue[2];
+// Number of transfer IDs handed out.
+static std::atomic<uint32_t> i2c_last_id;
+
+// Number of queued DMA transfers per SPI device.
+#define SPI_QUEUE_DEPTH CONFIG_BADGEABI_SPI_QUEUE_DEPTH
+// Longest SPI transfer in bytes.
+#define SPI_MAX_TRANSFER 32768
+
+// A queued SPI transfer.
+struct SpiRequest {
+	// Driver transaction, pointing at the app's buffers.
+	spi_transaction_t trans;
+	// Transfer ID, or 0 if this slot is free.
+	int  id;
+	// Whether the driver has returned it.
+	bool done;
+};
+
+// An SPI device added by a process.
+struct SpiDevice {
+	// Process that added it.
+	int pid;
+	// Driver handle.
+	spi_device_handle_t handle = nullptr;
+	// Protects the fields below; held while waiting for the driver.
+	std::mutex mtx;
+	// Queued transfers not yet waited for.
+	SpiRequest reqs[SPI_QUEUE_DEPTH] = {};
+	// Number of queued transfers the driver has not returned yet.
+	int inFlight = 0;
+	
+	// Collect one transfer from the driver, waiting at most `ticks`; the caller holds `mtx`.
+	// Returns whether a transfer was collected.
+	bool collect(TickType_t ticks) {
+		spi_transaction_t *trans;
+		if (spi_device_get_trans_result(handle, &trans, ticks) != ESP_OK) return false;
+		((SpiRequest *) trans->user)->done = true;
+		inFlight--;
+		return true;
+	}
+	
+	// Wait for all queued transfers to finish; the caller holds `mtx`.
+	void drain() {
+		while (inFlight && collect(portMAX_DELAY));
+	}
+};
+
+// Protects `spi_devices` and the SPI bus setup.
+static std::mutex spi_mtx;
+// SPI devices; handles are indices plus one.
+static std::vector<std::shared_ptr<SpiDevice>> spi_devices;
+// Pins the SPI bus was set up with as SCLK, MOSI and MISO, or empty if it was not.
+static std::optional<std::array<int, 3>> spi_pins;
+// Number of transfer IDs handed out.
+static std::atomic<uint32_t> spi_last_id;
 
 // Get the number of present GPIO pins.
 int io_cap_pin_count() {
@@ -121,7 +454,20 @@ uint32_t io_cap_i2c_speed(int interface) {
 }
 
 
-// TODO: SPI capabilities.
+// Get the number of SPI buses apps can use.
+int io_cap_spi_count() {
+	return 1;
+}
+
+// Get the highest clock speed in Hertz of an SPI bus.
+// Returns 0 if the bus does not exist.
+uint32_t io_cap_spi_speed(int bus) {
+	if (bus != 0) {
+		return 0;
+	} else {
+		return 40000000; // 40 MHz through the GPIO matrix.
+	}
+}
 
 
 // Read value from pin.
@@ -136,6 +482,24 @@ void io_write(int pin, bool value) {
 	gpio_set_level((gpio_num_t) pin, value);
 }
 
+// Read the level of all input pins in one operation, with bit N holding pin N.
+// Bits of pins that cannot be inputs are 0; bits of pins set to output are UNSPECIFIED.
+uint32_t io_read_mask() {
+	return REG_READ(GPIO_IN_REG) & io_input_mask;
+}
+
+// Drive the pins in `set_mask` high and the pins in `clear_mask` low, with bit N selecting pin N.
+// The pins in `set_mask` change just before the pins in `clear_mask`.
+// If a pin is set to input, the resulting behaviour is UNSPECIFIED.
+// Returns false without changing any pin if a pin cannot be an output or is in both masks.
+bool io_write_mask(uint32_t set_mask, uint32_t clear_mask) {
+	if (((set_mask | clear_mask) & ~io_output_mask) || (set_mask & clear_mask)) return false;
+	// The set and clear registers only change the pins whose bits are 1.
+	if (set_mask) REG_WRITE(GPIO_OUT_W1TS_REG, set_mask);
+	if (clear_mask) REG_WRITE(GPIO_OUT_W1TC_REG, clear_mask);
+	return true;
+}
+
 // Set mode of pin.
 // Returns whether the operation was successful.
 bool io_set_mode(int pin, io_mode_t mode) {
@@ -147,7 +511,7 @@ bool io_set_mode(int pin, io_mode_t mode) {
 			return gpio_set_direction((gpio_num_t) pin, GPIO_MODE_INPUT) == 0;
 			
 		case IO_MODE_OUTPUT:
-			return gpio_set_direction((gpio_num_t) pin, GPIO_MODE_INPUT) == 0;
+			return gpio_set_direction((gpio_num_t) pin, GPIO_MODE_OUTPUT) == 0;
 	}
 }
 
@@ -170,26 +534,260 @@ bool io_set_pull(int pin, io_pull_t dir) {
 }
 
 
+// Number of entries in a process' pin change event queue.
+#define IO_EVENT_DEPTH CONFIG_BADGEABI_IO_EVENT_DEPTH
+static_assert((IO_EVENT_DEPTH & (IO_EVENT_DEPTH - 1)) == 0, "IO_EVENT_DEPTH must be a power of two");
+
+// A pin change as recorded by the ISR.
+struct IoRawEvent {
+	// Time of the change in microseconds since boot.
+	int64_t  time_us;
+	// Pin that changed.
+	uint16_t pin;
+	// Level of the pin just after the change.
+	uint8_t  level;
+};
+
+// Pin change event queue of a process.
+// Single producer (the GPIO ISR), single consumer (the process' task).
+struct IoEvents {
+	// Task woken up when an event is queued.
+	TaskHandle_t task;
+	// Next event to be read, written by the process.
+	std::atomic<uint32_t> head;
+	// Next free event slot, written by the ISR.
+	std::atomic<uint32_t> tail;
+	// Number of events discarded because the queue was full.
+	std::atomic<uint32_t> dropped;
+	// Number of pins with a handler attached.
+	int attached;
+	// Queued events.
+	IoRawEvent ring[IO_EVENT_DEPTH];
+};
+
+// A pin change handler attached by a process.
+struct IoHandler {
+	// Process that attached the handler.
+	int pid;
+	// Event queue of that process.
+	IoEvents *events;
+	// User handler and cookie, returned with each event.
+	io_isr_t isr;
+	void    *cookie;
+};
+
+// Protects `io_handlers` and `io_events`.
+static std::mutex io_mtx;
+// Attached handler per pin.
+static IoHandler *io_handlers[31];
+// Event queue per process.
+static std::unordered_map<int, IoEvents *> io_events;
+// Whether the GPIO ISR service is installed.
+static bool io_isr_installed;
+
+// Get the PID of the calling process, or 0 if called by the firmware.
+static int io_caller() {
+	auto ctx = abi::getContext();
+	return ctx ? ctx->getPID() : 0;
+}
+
+// Pin change ISR: queue the event for the process, which runs the handler later.
+static void io_isr(void *arg) {
+	auto pin    = (int) (size_t) arg;
+	auto events = io_handlers[pin]->events;
+	
+	uint32_t tail = events->tail.load(std::memory_order_relaxed);
+	if (tail - events->head.load(std::memory_order_acquire) >= IO_EVENT_DEPTH) {
+		events->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	events->ring[tail & (IO_EVENT_DEPTH - 1)] = {
+		.time_us = esp_timer_get_time(),
+		.pin     = (uint16_t) pin,
+		.level   = (uint8_t) gpio_get_level((gpio_num_t) pin),
+	};
+	events->tail.store(tail + 1, std::memory_order_release);
+	
+	BaseType_t woken = pdFALSE;
+	vTaskNotifyGiveFromISR(events->task, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+// Remove the handler of a pin.
+// Must be called with `io_mtx` held.
+static void io_detach_locked(int pin) {
+	auto handler = io_handlers[pin];
+	gpio_set_intr_type((gpio_num_t) pin, GPIO_INTR_DISABLE);
+	gpio_isr_handler_remove((gpio_num_t) pin);
+	io_handlers[pin] = nullptr;
+	
+	// Release the event queue with the last handler.
+	auto events = handler->events;
+	if (--events->attached == 0) {
+		uint32_t dropped = events->dropped.load();
+		if (dropped) ESP_LOGW(TAG, "Process %d dropped %u pin change events", handler->pid, (unsigned) dropped);
+		io_events.erase(handler->pid);
+		delete events;
+	}
+	delete handler;
+}
+
 // Attach a pin change handler to a digital input pin.
-// The cookie value passed to the ISR will be NULL.
+// The cookie value passed to the ISR will be the same as COOKIE.
 // If a handler already exists, it will be replaced.
 // Returns whether the operation was successful.
-bool io_attach_isr(int pin, io_change_t when, io_isr_t isr) {
-	return false; // TODO.
+bool io_attach_isr_cookie(int pin, io_change_t when, io_isr_t isr, void *cookie) {
+	if (pin < 0 || pin >= io_cap_pin_count() || !isr) return false;
+	gpio_int_type_t type;
+	switch (when) {
+		default: return false;
+		case IO_CHANGE_RISING:  type = GPIO_INTR_POSEDGE;  break;
+		case IO_CHANGE_FALLING: type = GPIO_INTR_NEGEDGE;  break;
+		case IO_CHANGE_BOTH:    type = GPIO_INTR_ANYEDGE;  break;
+	}
+	int pid = io_caller();
+	
+	std::lock_guard lock(io_mtx);
+	if (!io_isr_installed) {
+		// The firmware may already have installed it.
+		auto res = gpio_install_isr_service(0);
+		if (res && res != ESP_ERR_INVALID_STATE) return false;
+		io_isr_installed = true;
+	}
+	
+	// Pins with a handler belong to that process until it is detached.
+	if (io_handlers[pin] && io_handlers[pin]->pid != pid) return false;
+	if (io_handlers[pin]) io_detach_locked(pin);
+	
+	// Get or create the event queue.
+	auto &events = io_events[pid];
+	if (!events) {
+		events       = new IoEvents();
+		events->task = xTaskGetCurrentTaskHandle();
+	}
+	events->attached++;
+	io_handlers[pin] = new IoHandler{ pid, events, isr, cookie };
+	
+	if (gpio_set_intr_type((gpio_num_t) pin, type)
+		|| gpio_isr_handler_add((gpio_num_t) pin, io_isr, (void *) (size_t) pin)
+		|| gpio_intr_enable((gpio_num_t) pin)) {
+		io_detach_locked(pin);
+		return false;
+	}
+	return true;
 }
 
 // Attach a pin change handler to a digital input pin.
-// The cookie value passed to the ISR will be the same as COOKIE.
+// The cookie value passed to the ISR will be NULL.
 // If a handler already exists, it will be replaced.
 // Returns whether the operation was successful.
-bool io_attach_isr_cookie(int pin, io_change_t when, io_isr_t isr, void *cookie) {
-	return false; // TODO.
+bool io_attach_isr(int pin, io_change_t when, io_isr_t isr) {
+	return io_attach_isr_cookie(pin, when, isr, nullptr);
 }
 
 // Detach a pin change handler.
 // Returns whether the operation was successful and there was a handler present.
 bool io_detach_isr(int pin) {
-	return false; // TODO.
+	if (pin < 0 || pin >= io_cap_pin_count()) return false;
+	int pid = io_caller();
+	
+	std::lock_guard lock(io_mtx);
+	if (!io_handlers[pin] || io_handlers[pin]->pid != pid) return false;
+	io_detach_locked(pin);
+	return true;
+}
+
+// Wait for pin change events and copy up to `cap` of them to `buf`.
+// A negative timeout waits forever, zero does not wait.
+// Returns the number of events, which may be 0 before the timeout ends, or -1 if no handlers are attached.
+int io_wait_events(io_event_t *buf, size_t cap, int64_t timeout_us) {
+	if (cap > SIZE_MAX / sizeof(io_event_t) || !abi::checkUserPtr(buf, cap * sizeof(io_event_t), true)) return -1;
+	int pid = io_caller();
+	
+	// Only this process' task may release its queue, so it remains valid without the lock.
+	IoEvents *events;
+	{
+		std::lock_guard lock(io_mtx);
+		auto iter = io_events.find(pid);
+		if (iter == io_events.end()) return -1;
+		events = iter->second;
+	}
+	
+	// Sleep until the ISR queues an event.
+	uint32_t head = events->head.load(std::memory_order_relaxed);
+	if (head == events->tail.load(std::memory_order_acquire) && timeout_us) {
+		TickType_t ticks = timeout_us < 0 ? portMAX_DELAY : pdMS_TO_TICKS((timeout_us + 999) / 1000);
+		ulTaskNotifyTake(pdTRUE, ticks);
+	}
+	
+	// Copy out all available events in one batch.
+	uint32_t tail  = events->tail.load(std::memory_order_acquire);
+	size_t   count = 0;
+	std::lock_guard lock(io_mtx);
+	for (; head != tail && count < cap; head++) {
+		auto &raw     = events->ring[head & (IO_EVENT_DEPTH - 1)];
+		auto  handler = io_handlers[raw.pin];
+		// Skip events of pins detached in the meantime.
+		if (!handler || handler->pid != pid) continue;
+		buf[count++] = {
+			.isr     = handler->isr,
+			.cookie  = handler->cookie,
+			.time_us = raw.time_us,
+			.pin     = raw.pin,
+			.level   = raw.level,
+		};
+	}
+	events->head.store(head, std::memory_order_release);
+	return count;
+}
+
+// Get the number of pin change events discarded because the event queue was full.
+uint32_t io_events_dropped() {
+	int pid = io_caller();
+	std::lock_guard lock(io_mtx);
+	auto iter = io_events.find(pid);
+	return iter == io_events.end() ? 0 : iter->second->dropped.load();
+}
+
+// Release all pin change handlers of process `pid`.
+void abi::gpio::releaseContext(int pid) {
+	std::lock_guard lock(io_mtx);
+	for (int pin = 0; pin < io_cap_pin_count(); pin++) {
+		if (io_handlers[pin] && io_handlers[pin]->pid == pid) io_detach_locked(pin);
+	}
+	{
+		std::lock_guard txn_lock(i2c_txn_mtx);
+		for (auto &txn: i2c_txns) {
+			if (txn && txn->pid == pid) txn = nullptr;
+		}
+	}
+	{
+		std::lock_guard async_lock(i2c_async_mtx);
+		i2c_async.erase(pid);
+	}
+	// Queued transfers of this process are now skipped; wait for one that may still be running.
+	for (auto &bus: i2c_bus) {
+		bus.releaseContext(pid);
+	}
+	// Queued SPI transfers use the process' memory directly, so they must finish first.
+	std::lock_guard spi_lock(spi_mtx);
+	for (auto &dev: spi_devices) {
+		if (!dev || dev->pid != pid) continue;
+		std::lock_guard dev_lock(dev->mtx);
+		dev->drain();
+		spi_bus_remove_device(dev->handle);
+		dev = nullptr;
+	}
+}
+
+// Wait for queued DMA transfers of process `pid`, which may use memory it is about to unmap.
+void abi::gpio::releaseMemory(int pid) {
+	std::lock_guard lock(spi_mtx);
+	for (auto &dev: spi_devices) {
+		if (!dev || dev->pid != pid) continue;
+		std::lock_guard dev_lock(dev->mtx);
+		dev->drain();
+	}
 }
 
 
@@ -197,22 +795,46 @@ bool io_detach_isr(int pin) {
 // Set up an I2C interface as I2C host.
 // Returns whether the operation was successful.
 bool i2c_host_init(int interface, int sda, int scl) {
-	// Set I2C parameters.
-	i2c_config_t config = {
-		.mode = I2C_MODE_MASTER,
-		.sda_io_num = (gpio_num_t) sda,
-		.scl_io_num = (gpio_num_t) scl,
-		.sda_pullup_en = true,
-		.scl_pullup_en = true,
-		.master = { .clk_speed = 100000 },
-		.clk_flags = 0,
-	};
-	auto res = i2c_param_config((i2c_port_t) interface, &config);
-	if (res) return false;
+	// Bounds check.
+	if (interface != 0 && interface != 1) return false;
+	int     pid = io_caller();
+	auto   &bus = i2c_bus[interface];
+	I2cHold hold(interface, pid);
+	if (!hold.ok) return false;
 	
-	// Install I2C driver.
-	res = i2c_driver_install((i2c_port_t) interface, I2C_MODE_MASTER, 0, 0, 0);
-	return res == 0;
+	// Other users keep the pins they set up the interface with.
+	bool moved = bus.sda != sda || bus.scl != scl;
+	{
+		std::lock_guard lock(bus.mtx);
+		bool shared = std::any_of(bus.users.begin(), bus.users.end(), [&](int user) { return user != pid; });
+		if (bus.installed && moved && shared) return false;
+	}
+	
+	if (!bus.installed || moved) {
+		// Set I2C parameters.
+		if (!i2c_bus_config(interface, sda, scl, I2C_DEFAULT_SPEED)) return false;
+		// Install I2C driver.
+		if (!bus.installed && i2c_driver_install((i2c_port_t) interface, I2C_MODE_MASTER, 0, 0, 0)) return false;
+		bus.installed = true;
+		bus.sda       = sda;
+		bus.scl       = scl;
+		bus.speed     = I2C_DEFAULT_SPEED;
+	}
+	
+	std::lock_guard lock(bus.mtx);
+	if (std::find(bus.users.begin(), bus.users.end(), pid) == bus.users.end()) bus.users.push_back(pid);
+	return true;
+}
+
+// Set the highest clock frequency of an I2C device (I2C host only).
+// The interface switches to it for each transaction of the calling process addressing the device.
+// Returns whether the operation was successful.
+bool i2c_set_device_speed(int interface, int device, uint32_t max_hz) {
+	if ((interface != 0 && interface != 1) || (device & ~0x3ff) || !max_hz) return false;
+	auto &bus = i2c_bus[interface];
+	std::lock_guard lock(bus.mtx);
+	bus.deviceSpeed[{ io_caller(), device }] = std::min(max_hz, io_cap_i2c_speed(interface));
+	return true;
 }
 
 // Start an I2C transaction (I2C host only).
@@ -237,11 +859,20 @@ bool i2c_host_stop(int interface) {
 	// Add stop command to queue.
 	int res = i2c_master_stop(host_cmd[interface]);
 	// Perform the actions.
-	res |= i2c_master_cmd_begin((i2c_port_t) interface, host_cmd[interface], pdMS_TO_TICKS(50));
+	{
+		I2cHold hold(interface, io_caller());
+		if (!i2c_host_recheck(interface) || !hold.ok || !i2c_bus_select(interface, io_caller(), host_addr[interface])) {
+			res = -1;
+		} else {
+			res |= i2c_master_cmd_begin((i2c_port_t) interface, host_cmd[interface], pdMS_TO_TICKS(I2C_TIMEOUT));
+		}
+	}
 	
 	// Clean up.
 	i2c_cmd_link_delete(host_cmd[interface]);
 	host_cmd[interface] = nullptr;
+	delete host_bufs[interface];
+	host_bufs[interface] = nullptr;
 	
 	return res == 0;
 }
@@ -250,7 +881,8 @@ bool i2c_host_stop(int interface) {
 // Write an I2C address (either 7-bit or 10-bit; I2C host only).
 // Returns whether the operation was successful and acknowledged.
 bool i2c_host_write_addr(int interface, int device, bool read_bit) {
-	if (device & ~0x3ff) return false;
+	if ((interface != 0 && interface != 1) || (device & ~0x3ff)) return false;
+	host_addr[interface] = device;
 	
 	if (device & 0x380) {
 		// 10-bit addressing.
@@ -279,9 +911,11 @@ bool i2c_host_write_byte(int interface, uint8_t send_byte) {
 bool i2c_host_read_byte(int interface, uint8_t *recv_byte) {
 	// Bounds check.
 	if (interface != 0 && interface != 1) return false;
+	if (!abi::checkUserPtr(recv_byte, 1, true)) return false;
 	// Create the context.
 	if (!host_cmd[interface]) host_cmd[interface] = i2c_cmd_link_create();
 	// Add read command to the queue.
+	i2c_host_track(interface, recv_byte, 1, true);
 	return i2c_master_read_byte(host_cmd[interface], recv_byte, I2C_MASTER_ACK) == 0;
 }
 
@@ -291,9 +925,11 @@ bool i2c_host_read_byte(int interface, uint8_t *recv_byte) {
 bool i2c_host_write_bytes(int interface, const uint8_t *send_buf, size_t send_len) {
 	// Bounds check.
 	if (interface != 0 && interface != 1) return false;
+	if (!abi::checkUserPtr(send_buf, send_len)) return false;
 	// Create the context.
 	if (!host_cmd[interface]) host_cmd[interface] = i2c_cmd_link_create();
 	// Add write command to the queue.
+	i2c_host_track(interface, send_buf, send_len, false);
 	return i2c_master_write(host_cmd[interface], send_buf, send_len, 1) == 0;
 }
 
@@ -303,9 +939,11 @@ bool i2c_host_write_bytes(int interface, const uint8_t *send_buf, size_t send_le
 bool i2c_host_read_bytes(int interface, uint8_t *recv_buf, size_t recv_len) {
 	// Bounds check.
 	if (interface != 0 && interface != 1) return false;
+	if (!abi::checkUserPtr(recv_buf, recv_len, true)) return false;
 	// Create the context.
 	if (!host_cmd[interface]) host_cmd[interface] = i2c_cmd_link_create();
 	// Add read command to the queue.
+	i2c_host_track(interface, recv_buf, recv_len, true);
 	return i2c_master_read(host_cmd[interface], recv_buf, recv_len, I2C_MASTER_ACK) == 0;
 }
 
@@ -330,6 +968,451 @@ bool i2c_host_read_from(int interface, int device, uint8_t *recv_buf, size_t rec
 }
 
 
+
+// Add an I2C address to a command link (either 7-bit or 10-bit).
+static bool i2c_add_addr(i2c_cmd_handle_t cmd, int device, bool read_bit) {
+	if (device & 0x380) {
+		// 10-bit addressing.
+		return i2c_master_write_byte(cmd, 0xf0 | ((device >> 7) & 0x06) | read_bit, 1) == 0
+			&& i2c_master_write_byte(cmd, device, 1) == 0;
+	} else {
+		// 7-bit addressing.
+		return i2c_master_write_byte(cmd, (device << 1) | read_bit, 1) == 0;
+	}
+}
+
+// Get a prepared I2C transaction of a process.
+// Returns null if it does not exist.
+static std::shared_ptr<I2cTxn> i2c_txn_find(int txn, int pid) {
+	std::lock_guard lock(i2c_txn_mtx);
+	if (txn < 1 || (size_t) txn > i2c_txns.size()) return nullptr;
+	auto &ptr = i2c_txns[txn - 1];
+	return ptr && ptr->pid == pid ? ptr : nullptr;
+}
+
+// Get a prepared I2C transaction of the calling process.
+// Returns null if it does not exist.
+static std::shared_ptr<I2cTxn> i2c_txn_get(int txn) {
+	return i2c_txn_find(txn, io_caller());
+}
+
+// Run a prepared I2C transaction; the caller holds its interface and has checked the buffers.
+static bool i2c_txn_transfer(I2cTxn *ptr, const uint8_t *write_buf, uint8_t *read_buf) {
+	if (!i2c_bus_select(ptr->interface, ptr->pid, ptr->device)) return false;
+	memcpy(ptr->data.get(), write_buf, ptr->writeLen);
+	if (i2c_master_cmd_begin((i2c_port_t) ptr->interface, ptr->cmd, pdMS_TO_TICKS(I2C_TIMEOUT))) return false;
+	memcpy(read_buf, ptr->data.get() + ptr->writeLen, ptr->readLen);
+	return true;
+}
+
+// Run a prepared I2C transaction on user buffers; the caller holds its interface.
+static bool i2c_txn_run(I2cTxn *ptr, const uint8_t *write_buf, uint8_t *read_buf) {
+	if (!abi::checkUserPtr(write_buf, ptr->writeLen) || !abi::checkUserPtr(read_buf, ptr->readLen, true)) return false;
+	return i2c_txn_transfer(ptr, write_buf, read_buf);
+}
+
+// Prepare an I2C transaction (I2C host only): address `device`, write `write_len` bytes,
+// then if `read_len` is not 0, a repeated start and read `read_len` bytes.
+// Automatically chooses 7-bit or 10-bit I2C device addressing.
+// Returns a handle, or -1 on failure.
+int i2c_txn_prepare(int interface, int device, size_t write_len, size_t read_len) {
+	if ((interface != 0 && interface != 1) || (device & ~0x3ff) || write_len > SIZE_MAX - read_len) return -1;
+	auto txn = std::make_shared<I2cTxn>();
+	txn->pid       = io_caller();
+	txn->interface = interface;
+	txn->device    = device;
+	txn->writeLen  = write_len;
+	txn->readLen   = read_len;
+	txn->data.reset(new (std::nothrow) uint8_t[write_len + read_len + 1]);
+	txn->cmd = i2c_cmd_link_create_static(txn->link, sizeof(txn->link));
+	if (!txn->data || !txn->cmd) return -1;
+	
+	// Build the command link once; its data lives in `data`.
+	i2c_cmd_handle_t cmd = txn->cmd;
+	bool res = i2c_master_start(cmd) == 0 && i2c_add_addr(cmd, device, !write_len);
+	if (write_len) {
+		res = res && i2c_master_write(cmd, txn->data.get(), write_len, 1) == 0;
+		if (read_len) res = res && i2c_master_start(cmd) == 0 && i2c_add_addr(cmd, device, 1);
+	}
+	if (read_len) {
+		res = res && i2c_master_read(cmd, txn->data.get() + write_len, read_len, I2C_MASTER_LAST_NACK) == 0;
+	}
+	res = res && i2c_master_stop(cmd) == 0;
+	if (!res) return -1;
+	
+	std::lock_guard lock(i2c_txn_mtx);
+	for (size_t i = 0; i < i2c_txns.size(); i++) {
+		if (!i2c_txns[i]) {
+			i2c_txns[i] = std::move(txn);
+			return i + 1;
+		}
+	}
+	i2c_txns.push_back(std::move(txn));
+	return i2c_txns.size();
+}
+
+// Free a prepared I2C transaction.
+// Returns success status.
+bool i2c_txn_free(int txn) {
+	if (!i2c_txn_get(txn)) return false;
+	std::lock_guard lock(i2c_txn_mtx);
+	i2c_txns[txn - 1] = nullptr;
+	return true;
+}
+
+// Run a prepared I2C transaction, writing from `write_buf` and reading into `read_buf`.
+// Returns whether the operation was successful.
+bool i2c_txn_exec(int txn, const uint8_t *write_buf, uint8_t *read_buf) {
+	auto ptr = i2c_txn_get(txn);
+	if (!ptr) return false;
+	I2cHold hold(ptr->interface, io_caller());
+	return hold.ok && i2c_txn_run(ptr.get(), write_buf, read_buf);
+}
+
+// Run several prepared I2C transactions back to back, without other transactions in between.
+// Returns the number of transactions that succeeded.
+size_t i2c_txn_exec_batch(i2c_batch_t *batch, size_t count) {
+	if (count > SIZE_MAX / sizeof(i2c_batch_t) || !abi::checkUserPtr(batch, count * sizeof(i2c_batch_t), true)) return 0;
+	// Hold every interface used, in a fixed order.
+	bool used[2] = { false, false };
+	for (size_t i = 0; i < count; i++) {
+		auto ptr = i2c_txn_get(batch[i].txn);
+		if (ptr) used[ptr->interface] = true;
+	}
+	int pid = io_caller();
+	std::optional<I2cHold> holds[2];
+	for (int interface = 0; interface < 2; interface++) {
+		if (used[interface]) holds[interface].emplace(interface, pid);
+	}
+	
+	size_t done = 0;
+	for (size_t i = 0; i < count; i++) {
+		auto ptr = i2c_txn_get(batch[i].txn);
+		batch[i].ok = ptr && holds[ptr->interface] && holds[ptr->interface]->ok
+			&& i2c_txn_run(ptr.get(), batch[i].write_buf, batch[i].read_buf);
+		done += batch[i].ok;
+	}
+	return done;
+}
+
+
+
+// Record the completion of an asynchronous I2C transfer and wake up its process.
+static void i2c_complete(I2cRequest const &req, abi::BUFPTR data, bool ok) {
+	std::lock_guard lock(i2c_async_mtx);
+	auto iter = i2c_async.find(req.pid);
+	if (iter == i2c_async.end()) return;
+	auto &async = iter->second;
+	async.pending.erase(std::find(async.pending.begin(), async.pending.end(), req.id));
+	async.done.push_back({
+		.info     = { .id = req.id, .txn = req.txn, .cookie = req.cookie, .ok = ok },
+		.data     = std::move(data),
+		.writeLen = req.writeLen,
+		.readLen  = req.readLen,
+		.read_buf = req.read_buf,
+	});
+	xTaskNotifyGive(async.task);
+}
+
+// Copy the bytes read by a completed transfer to the app; runs in the context of the app that submitted it.
+// Returns the transfer as seen by the app.
+static i2c_done_t i2c_collect(I2cDone const &done) {
+	i2c_done_t info = done.info;
+	if (info.ok && done.readLen) {
+		if (abi::checkUserPtr(done.read_buf, done.readLen, true)) {
+			memcpy(done.read_buf, done.data.get() + done.writeLen, done.readLen);
+		} else {
+			info.ok = false;
+		}
+	}
+	return info;
+}
+
+// Bus worker of an I2C interface: runs queued transfers in order.
+static void i2c_worker(void *arg) {
+	auto       queue = (QueueHandle_t) arg;
+	I2cRequest req;
+	while (xQueueReceive(queue, &req, portMAX_DELAY) == pdTRUE) {
+		abi::BUFPTR data(req.data);
+		bool ok  = false;
+		auto txn = i2c_txn_find(req.txn, req.pid);
+		// The handle may have been freed and prepared again with other lengths.
+		if (txn && txn->writeLen == req.writeLen && txn->readLen == req.readLen) {
+			I2cHold hold(txn->interface, req.pid);
+			// Processes that exit wait for their transaction to release the bus before their memory is released.
+			bool alive;
+			{
+				std::lock_guard lock(i2c_async_mtx);
+				alive = i2c_async.count(req.pid);
+			}
+			if (hold.ok && alive) ok = i2c_txn_transfer(txn.get(), data.get(), data.get() + req.writeLen);
+		}
+		i2c_complete(req, std::move(data), ok);
+	}
+	vTaskDelete(NULL);
+}
+
+// Queue a prepared I2C transaction to run in the background.
+// The bytes to write are copied right away; the bytes read are copied to `read_buf` when the transfer is collected.
+// Returns a transfer ID, or -1 if the transfer queue is full.
+int i2c_txn_submit(int txn, const uint8_t *write_buf, uint8_t *read_buf, void *cookie) {
+	auto ptr = i2c_txn_get(txn);
+	if (!ptr || !abi::checkUserPtr(write_buf, ptr->writeLen) || !abi::checkUserPtr(read_buf, ptr->readLen, true)) return -1;
+	int pid = io_caller();
+	
+	std::lock_guard lock(i2c_async_mtx);
+	auto &queue = i2c_queue[ptr->interface];
+	if (!queue) {
+		queue = xQueueCreate(I2C_QUEUE_DEPTH, sizeof(I2cRequest));
+		if (!queue) return -1;
+		if (xTaskCreate(i2c_worker, "i2c", I2C_TASK_STACK, queue, uxTaskPriorityGet(NULL), NULL) != pdPASS) {
+			vQueueDelete(queue);
+			queue = nullptr;
+			return -1;
+		}
+	}
+	
+	// Completed transfers count until collected, so an app that never collects them cannot grow the queue.
+	auto &async = i2c_async[pid];
+	if (!async.task) async.task = xTaskGetCurrentTaskHandle();
+	if (async.pending.size() + async.done.size() >= I2C_QUEUE_DEPTH) return -1;
+	
+	// The bus worker runs outside the app's context, so it works on a copy.
+	abi::BUFPTR data((uint8_t *) malloc(ptr->writeLen + ptr->readLen + 1));
+	if (!data) return -1;
+	memcpy(data.get(), write_buf, ptr->writeLen);
+	
+	I2cRequest req = {
+		.id        = (int) (i2c_last_id.fetch_add(1, std::memory_order_relaxed) % INT_MAX) + 1,
+		.pid       = pid,
+		.txn       = txn,
+		.writeLen  = ptr->writeLen,
+		.readLen   = ptr->readLen,
+		.data      = data.get(),
+		.read_buf  = read_buf,
+		.cookie    = cookie,
+	};
+	if (xQueueSend(queue, &req, 0) != pdTRUE) return -1;
+	data.release();
+	async.pending.push_back(req.id);
+	return req.id;
+}
+
+// Wait for an asynchronous I2C transfer to complete.
+// A negative timeout waits forever, zero does not wait.
+// Returns 1 if it succeeded, 0 if it failed, or -1 if it did not complete in time or does not exist.
+int i2c_txn_wait(int id, int64_t timeout_us) {
+	int     pid      = io_caller();
+	int64_t deadline = timeout_us < 0 ? INT64_MAX : esp_timer_get_time() + timeout_us;
+	while (true) {
+		{
+			std::lock_guard lock(i2c_async_mtx);
+			auto iter = i2c_async.find(pid);
+			if (iter == i2c_async.end()) return -1;
+			auto &async = iter->second;
+			for (auto done = async.done.begin(); done != async.done.end(); done++) {
+				if (done->info.id == id) {
+					bool ok = i2c_collect(*done).ok;
+					async.done.erase(done);
+					return ok;
+				}
+			}
+			if (std::find(async.pending.begin(), async.pending.end(), id) == async.pending.end()) return -1;
+		}
+		
+		// Sleep until the bus worker completes a transfer.
+		int64_t now = esp_timer_get_time();
+		if (now >= deadline) return -1;
+		TickType_t ticks = timeout_us < 0 ? portMAX_DELAY : pdMS_TO_TICKS((deadline - now + 999) / 1000);
+		ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+	}
+}
+
+// Wait for asynchronous I2C transfers to complete and copy up to `cap` of them to `buf`.
+// A negative timeout waits forever, zero does not wait.
+// Returns the number of transfers, which may be 0 before the timeout ends, or -1 if none were submitted.
+int i2c_wait_done(i2c_done_t *buf, size_t cap, int64_t timeout_us) {
+	if (cap > SIZE_MAX / sizeof(i2c_done_t) || !abi::checkUserPtr(buf, cap * sizeof(i2c_done_t), true)) return -1;
+	int pid = io_caller();
+	
+	std::unique_lock lock(i2c_async_mtx);
+	auto iter = i2c_async.find(pid);
+	if (iter == i2c_async.end()) return -1;
+	if (iter->second.done.empty() && !iter->second.pending.empty() && timeout_us) {
+		// Sleep until the bus worker completes a transfer.
+		lock.unlock();
+		TickType_t ticks = timeout_us < 0 ? portMAX_DELAY : pdMS_TO_TICKS((timeout_us + 999) / 1000);
+		ulTaskNotifyTake(pdTRUE, ticks);
+		lock.lock();
+		iter = i2c_async.find(pid);
+		if (iter == i2c_async.end()) return -1;
+	}
+	
+	// Copy out all completed transfers in one batch.
+	auto  &done  = iter->second.done;
+	size_t count = 0;
+	for (; count < cap && !done.empty(); count++) {
+		buf[count] = i2c_collect(done.front());
+		done.pop_front();
+	}
+	return count;
+}
+
+
+// Get an SPI device of the calling process.
+// Returns null if it does not exist.
+static std::shared_ptr<SpiDevice> spi_device_get(int device) {
+	std::lock_guard lock(spi_mtx);
+	if (device < 1 || (size_t) device > spi_devices.size()) return nullptr;
+	auto &ptr = spi_devices[device - 1];
+	return ptr && ptr->pid == io_caller() ? ptr : nullptr;
+}
+
+// Check the buffers of an SPI transfer.
+static bool spi_check(const void *tx, void *rx, size_t len) {
+	if ((!tx && !rx) || !len || len > SPI_MAX_TRANSFER) return false;
+	return (!tx || abi::checkUserPtr(tx, len)) && (!rx || abi::checkUserPtr(rx, len, true));
+}
+
+// Set up an SPI bus as host; `miso` may be -1 if the bus only sends.
+// Calling it again with the same pins succeeds without changing anything.
+// Returns whether the operation was successful.
+bool spi_host_init(int bus, int sclk, int mosi, int miso) {
+	if (bus != 0
+		|| !(io_cap_pin(sclk) & IO_CAP_SPI_CLOCK)
+		|| !(io_cap_pin(mosi) & IO_CAP_SPI_SEND)
+		|| (miso != -1 && !(io_cap_pin(miso) & IO_CAP_SPI_RECV))) return false;
+	std::array<int, 3> pins = { sclk, mosi, miso };
+	
+	std::lock_guard lock(spi_mtx);
+	if (spi_pins) return *spi_pins == pins;
+	spi_bus_config_t config = {};
+	config.sclk_io_num     = sclk;
+	config.mosi_io_num     = mosi;
+	config.miso_io_num     = miso;
+	config.quadwp_io_num   = -1;
+	config.quadhd_io_num   = -1;
+	config.data4_io_num    = -1;
+	config.data5_io_num    = -1;
+	config.data6_io_num    = -1;
+	config.data7_io_num    = -1;
+	config.max_transfer_sz = SPI_MAX_TRANSFER;
+	if (spi_bus_initialize(SPI2_HOST, &config, SPI_DMA_CH_AUTO) != ESP_OK) return false;
+	spi_pins = pins;
+	return true;
+}
+
+// Add a device to an SPI bus with its own chip select pin (or -1), clock speed and SPI mode (0-3).
+// Returns a device handle, or -1 on failure.
+int spi_device_add(int bus, int cs, uint32_t clock_hz, int mode) {
+	if (bus != 0 || mode < 0 || mode > 3 || !clock_hz || clock_hz > io_cap_spi_speed(bus)) return -1;
+	if (cs != -1 && !(io_cap_pin(cs) & IO_CAP_OUTPUT)) return -1;
+	auto dev = std::make_shared<SpiDevice>();
+	dev->pid = io_caller();
+	for (auto &req: dev->reqs) {
+		req.trans.user = &req;
+	}
+	
+	std::lock_guard lock(spi_mtx);
+	if (!spi_pins) return -1;
+	spi_device_interface_config_t config = {};
+	config.mode           = mode;
+	config.clock_speed_hz = clock_hz;
+	config.spics_io_num   = cs;
+	config.queue_size     = SPI_QUEUE_DEPTH;
+	if (spi_bus_add_device(SPI2_HOST, &config, &dev->handle) != ESP_OK) return -1;
+	
+	for (size_t i = 0; i < spi_devices.size(); i++) {
+		if (!spi_devices[i]) {
+			spi_devices[i] = std::move(dev);
+			return i + 1;
+		}
+	}
+	spi_devices.push_back(std::move(dev));
+	return spi_devices.size();
+}
+
+// Remove an SPI device, waiting for its queued transfers first.
+// Returns success status.
+bool spi_device_remove(int device) {
+	auto ptr = spi_device_get(device);
+	if (!ptr) return false;
+	{
+		std::lock_guard lock(ptr->mtx);
+		ptr->drain();
+		spi_bus_remove_device(ptr->handle);
+	}
+	std::lock_guard lock(spi_mtx);
+	spi_devices[device - 1] = nullptr;
+	return true;
+}
+
+// Send `len` bytes from `tx` while receiving `len` bytes into `rx`, and wait for it to finish.
+// Either buffer may be NULL. Meant for short messages; waits for queued transfers of the device first.
+// Returns whether the operation was successful.
+bool spi_transfer(int device, const void *tx, void *rx, size_t len) {
+	auto ptr = spi_device_get(device);
+	if (!ptr || !spi_check(tx, rx, len)) return false;
+	spi_transaction_t trans = {};
+	trans.length    = len * 8;
+	trans.tx_buffer = tx;
+	trans.rx_buffer = rx;
+	
+	// The driver cannot mix polling with queued transfers.
+	std::lock_guard lock(ptr->mtx);
+	ptr->drain();
+	return spi_device_polling_transmit(ptr->handle, &trans) == ESP_OK;
+}
+
+// Queue a DMA transfer of `len` bytes from `tx` while receiving into `rx`; either buffer may be NULL.
+// The buffers are used directly and must remain valid until `spi_wait` returns true for the transfer.
+// Unmapping memory first waits for all queued transfers of the process.
+// Returns a transfer ID, or -1 if the transfer queue is full.
+int spi_submit(int device, const void *tx, void *rx, size_t len) {
+	auto ptr = spi_device_get(device);
+	if (!ptr || !spi_check(tx, rx, len)) return -1;
+	
+	std::lock_guard lock(ptr->mtx);
+	for (auto &req: ptr->reqs) {
+		if (req.id) continue;
+		req.trans.length    = len * 8;
+		req.trans.tx_buffer = tx;
+		req.trans.rx_buffer = rx;
+		if (spi_device_queue_trans(ptr->handle, &req.trans, 0) != ESP_OK) return -1;
+		req.id   = (int) (spi_last_id.fetch_add(1, std::memory_order_relaxed) % INT_MAX) + 1;
+		req.done = false;
+		ptr->inFlight++;
+		return req.id;
+	}
+	return -1;
+}
+
+// Wait for a queued SPI transfer to finish.
+// A negative timeout waits forever, zero does not wait.
+// Returns whether the transfer finished; false if it did not finish in time or does not exist.
+bool spi_wait(int device, int id, int64_t timeout_us) {
+	auto ptr = spi_device_get(device);
+	if (!ptr || id < 1) return false;
+	int64_t deadline = timeout_us < 0 ? INT64_MAX : esp_timer_get_time() + timeout_us;
+	
+	std::lock_guard lock(ptr->mtx);
+	auto req = std::find_if(std::begin(ptr->reqs), std::end(ptr->reqs), [&](SpiRequest const &slot) { return slot.id == id; });
+	if (req == std::end(ptr->reqs)) return false;
+	
+	// The driver returns transfers in order, so earlier ones are collected on the way.
+	while (!req->done) {
+		TickType_t ticks = portMAX_DELAY;
+		if (timeout_us >= 0) {
+			int64_t left = std::max<int64_t>(deadline - esp_timer_get_time(), 0);
+			ticks = pdMS_TO_TICKS((left + 999) / 1000);
+		}
+		if (!ptr->collect(ticks)) return false;
+	}
+	req->id = 0;
+	return true;
+}
+
+
 // Exports ABI symbols into `map` (no wrapper).
 void abi::gpio::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["io_cap_pin_count"]		= (size_t) &io_cap_pin_count;
@@ -337,13 +1420,20 @@ void abi::gpio::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["io_cap_i2c_count"]		= (size_t) &io_cap_i2c_count;
 	map["io_cap_i2c"]			= (size_t) &io_cap_i2c;
 	map["io_cap_i2c_speed"]		= (size_t) &io_cap_i2c_speed;
+	map["io_cap_spi_count"]		= (size_t) &io_cap_spi_count;
+	map["io_cap_spi_speed"]		= (size_t) &io_cap_spi_speed;
 	map["io_read"]				= (size_t) &io_read;
 	map["io_write"]				= (size_t) &io_write;
+	map["io_read_mask"]			= (size_t) &io_read_mask;
+	map["io_write_mask"]		= (size_t) &io_write_mask;
 	map["io_set_mode"]			= (size_t) &io_set_mode;
 	map["io_set_pull"]			= (size_t) &io_set_pull;
 	map["io_attach_isr"]		= (size_t) &io_attach_isr;
 	map["io_attach_isr_cookie"]	= (size_t) &io_attach_isr_cookie;
 	map["io_detach_isr"]		= (size_t) &io_detach_isr;
+	map["io_wait_events"]		= (size_t) &io_wait_events;
+	map["io_events_dropped"]	= (size_t) &io_events_dropped;
+	map["i2c_set_device_speed"]	= (size_t) &i2c_set_device_speed;
 	map["i2c_host_init"]		= (size_t) &i2c_host_init;
 	map["i2c_host_start"]		= (size_t) &i2c_host_start;
 	map["i2c_host_stop"]		= (size_t) &i2c_host_stop;
@@ -354,5 +1444,18 @@ void abi::gpio::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["i2c_host_read_bytes"]	= (size_t) &i2c_host_read_bytes;
 	map["i2c_host_write_to"]	= (size_t) &i2c_host_write_to;
 	map["i2c_host_read_from"]	= (size_t) &i2c_host_read_from;
+	map["i2c_txn_prepare"]		= (size_t) &i2c_txn_prepare;
+	map["i2c_txn_free"]			= (size_t) &i2c_txn_free;
+	map["i2c_txn_exec"]			= (size_t) &i2c_txn_exec;
+	map["i2c_txn_exec_batch"]	= (size_t) &i2c_txn_exec_batch;
+	map["i2c_txn_submit"]		= (size_t) &i2c_txn_submit;
+	map["i2c_txn_wait"]			= (size_t) &i2c_txn_wait;
+	map["i2c_wait_done"]		= (size_t) &i2c_wait_done;
+	map["spi_host_init"]		= (size_t) &spi_host_init;
+	map["spi_device_add"]		= (size_t) &spi_device_add;
+	map["spi_device_remove"]	= (size_t) &spi_device_remove;
+	map["spi_transfer"]			= (size_t) &spi_transfer;
+	map["spi_submit"]			= (size_t) &spi_submit;
+	map["spi_wait"]				= (size_t) &spi_wait;
 }
 
@@ -30,5 +30,9 @@ namespace abi::gpio {
 
 // Exports ABI symbols into `map` (no wrapper).
 void exportSymbolsUnwrapped(elf::SymMap &map);
+// Release all pin change handlers of process `pid`.
+void releaseContext(int pid);
+// Wait for queued DMA transfers of process `pid`, which may use memory it is about to unmap.
+void releaseMemory(int pid);
 
 }
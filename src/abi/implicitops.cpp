@@ -190,3 +190,13 @@ void abi::implicitops::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["__moddi3"]  = (size_t) &__moddi3;
 	map["__umoddi3"] = (size_t) &__umoddi3;
 }
+
+// Exports trust classes of ABI symbols into `map`.
+void abi::implicitops::exportTrust(TrustMap &map) {
+	// Implicit operations are all pure arithmetic.
+	elf::SymMap syms;
+	exportSymbolsUnwrapped(syms);
+	for (const auto &entry: syms) {
+		map[entry.first] = Trust::PURE;
+	}
+}
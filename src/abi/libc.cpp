@@ -24,9 +24,18 @@
 
 #include "libc.hpp"
 
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <mutex>
+#include <type_traits>
+#include <unordered_set>
+
 #include <abi.hpp>
 
 
@@ -57,6 +66,613 @@ static void appExited(int ec) {
 }
 
 
+// Measure a user string of at most `max` characters.
+// Returns false if it runs past the end of its mapping first.
+static bool user_strnlen(const char *str, size_t max, size_t &len) {
+	size_t span = abi::userSpan(str);
+	len = strnlen(str, std::min(max, span));
+	return max <= span || len < span;
+}
+
+// Check that a user string is terminated within its mapping.
+static bool user_str(const char *str) {
+	size_t len;
+	return user_strnlen(str, SIZE_MAX, len);
+}
+
+// Check that a user pointer may hold a `T` unless it is null.
+template <typename T>
+static bool user_opt(T *ptr) {
+	return !ptr || abi::checkUserPtr(ptr, sizeof(T), !std::is_const_v<T>);
+}
+
+// Check that the argument words read from `args` by the time it became `end` lie in user memory.
+// A `va_list` passed to an ABI call points straight at the caller's argument words.
+static bool user_va_list(va_list args, va_list end) {
+#ifdef __riscv
+	return abi::checkUserPtr(args, (size_t) end - (size_t) args);
+#else
+	return true;
+#endif
+}
+
+
+
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+// Files opened by apps; apps may pass only these and the standard streams back in.
+static std::unordered_set<FILE *> openFiles;
+// Mutex guarding `openFiles`.
+static std::mutex openFilesMtx;
+#endif
+
+// Check that a FILE passed by an app was handed out to it.
+static bool user_file(FILE *fd) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	if (!abi::getContext() || fd == stdin || fd == stdout || fd == stderr) return true;
+	std::lock_guard lock(openFilesMtx);
+	return openFiles.count(fd);
+#else
+	return true;
+#endif
+}
+
+// Record a FILE handed out to an app.
+static FILE *user_file_add(FILE *fd) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	if (fd) {
+		std::lock_guard lock(openFilesMtx);
+		openFiles.insert(fd);
+	}
+#endif
+	return fd;
+}
+
+// Forget a FILE that an app closed.
+static void user_file_remove(FILE *fd) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	std::lock_guard lock(openFilesMtx);
+	openFiles.erase(fd);
+#endif
+}
+
+
+
+// Length modifiers of printf and scanf conversions.
+enum class FmtLen {
+	NONE, HH, H, L, LL, J, Z, T, BIG_L,
+};
+
+// Parse the length modifier of a printf or scanf conversion.
+static FmtLen parse_fmt_len(const char *&fmt) {
+	switch (*fmt) {
+		case 'h': fmt++; if (*fmt == 'h') { fmt++; return FmtLen::HH; } return FmtLen::H;
+		case 'l': fmt++; if (*fmt == 'l') { fmt++; return FmtLen::LL; } return FmtLen::L;
+		case 'q': fmt++; return FmtLen::LL;
+		case 'j': fmt++; return FmtLen::J;
+		case 'z': fmt++; return FmtLen::Z;
+		case 't': fmt++; return FmtLen::T;
+		case 'L': fmt++; return FmtLen::BIG_L;
+		default: return FmtLen::NONE;
+	}
+}
+
+// Parse a decimal field width or precision; false if it is out of range.
+static bool parse_fmt_num(const char *&fmt, size_t &out) {
+	out = 0;
+	while (isdigit((unsigned char) *fmt)) {
+		if (out > SIZE_MAX / 20) return false;
+		out = out * 10 + (*fmt++ - '0');
+	}
+	return *fmt != '$';
+}
+
+// Check the format string and the arguments of a printf-style call.
+// `%n` and positional arguments are refused.
+static bool check_printf(const char *fmt, va_list args) {
+	if (!user_str(fmt)) return false;
+	va_list ap;
+	va_copy(ap, args);
+	bool ok = true;
+	
+	while (ok && (fmt = strchr(fmt, '%'))) {
+		fmt++;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+		
+		// Flags, field width and precision.
+		size_t num, prec = SIZE_MAX;
+		fmt += strspn(fmt, "-+ #0'");
+		if (*fmt == '*') {
+			fmt++;
+			va_arg(ap, int);
+		} else if (!parse_fmt_num(fmt, num)) {
+			ok = false;
+			break;
+		}
+		if (*fmt == '.') {
+			fmt++;
+			if (*fmt == '*') {
+				fmt++;
+				int tmp = va_arg(ap, int);
+				if (tmp >= 0) prec = tmp;
+			} else if (!parse_fmt_num(fmt, prec)) {
+				ok = false;
+				break;
+			}
+		}
+		
+		// Conversion.
+		FmtLen len = parse_fmt_len(fmt);
+		switch (*fmt++) {
+			case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+				switch (len) {
+					case FmtLen::L:  va_arg(ap, long);      break;
+					case FmtLen::LL: va_arg(ap, long long); break;
+					case FmtLen::J:  va_arg(ap, intmax_t);  break;
+					case FmtLen::Z:  va_arg(ap, size_t);    break;
+					case FmtLen::T:  va_arg(ap, ptrdiff_t); break;
+					default:         va_arg(ap, int);       break;
+				}
+				break;
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				if (len == FmtLen::BIG_L) {
+					va_arg(ap, long double);
+				} else {
+					va_arg(ap, double);
+				}
+				break;
+			case 'p':
+				va_arg(ap, void *);
+				break;
+			case 's': {
+				// Wide strings are not supported; null prints as "(null)".
+				const char *str = va_arg(ap, const char *);
+				size_t      slen;
+				ok = len == FmtLen::NONE && (!str || user_strnlen(str, prec, slen));
+				break;
+			}
+			default:
+				// `%n` writes to memory and unknown conversions have unknown arguments.
+				ok = false;
+				break;
+		}
+	}
+	
+	ok = ok && user_va_list(args, ap);
+	va_end(ap);
+	return ok;
+}
+
+// Check the format string and the output arguments of a scanf-style call.
+// `%s` and `%[` without a field width and positional arguments are refused.
+static bool check_scanf(const char *fmt, va_list args) {
+	if (!user_str(fmt)) return false;
+	va_list ap;
+	va_copy(ap, args);
+	bool ok = true;
+	
+	while (ok && (fmt = strchr(fmt, '%'))) {
+		fmt++;
+		if (*fmt == '%') {
+			fmt++;
+			continue;
+		}
+		
+		// Assignment suppression and field width.
+		bool   store = *fmt != '*';
+		size_t width;
+		if (!store) fmt++;
+		if (!parse_fmt_num(fmt, width)) {
+			ok = false;
+			break;
+		}
+		
+		// Conversion and the size of what it stores.
+		FmtLen len = parse_fmt_len(fmt);
+		size_t size;
+		switch (*fmt++) {
+			case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'n':
+				switch (len) {
+					case FmtLen::HH: size = sizeof(char);      break;
+					case FmtLen::H:  size = sizeof(short);     break;
+					case FmtLen::L:  size = sizeof(long);      break;
+					case FmtLen::LL: size = sizeof(long long); break;
+					case FmtLen::J:  size = sizeof(intmax_t);  break;
+					case FmtLen::Z:  size = sizeof(size_t);    break;
+					case FmtLen::T:  size = sizeof(ptrdiff_t); break;
+					default:         size = sizeof(int);       break;
+				}
+				break;
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				size = len == FmtLen::BIG_L ? sizeof(long double) : len == FmtLen::L ? sizeof(double) : sizeof(float);
+				break;
+			case 'p':
+				size = sizeof(void *);
+				break;
+			case 'c':
+				size = (width ? width : 1) * (len == FmtLen::L ? sizeof(wchar_t) : 1);
+				break;
+			case '[':
+				// Skip the scan set; a leading `]` is part of it.
+				if (*fmt == '^') fmt++;
+				if (*fmt == ']') fmt++;
+				fmt = strchr(fmt, ']');
+				if (!fmt) {
+					ok = false;
+					continue;
+				}
+				fmt++;
+				/* fallthrough */
+			case 's':
+				ok   = width != 0;
+				size = (width + 1) * (len == FmtLen::L ? sizeof(wchar_t) : 1);
+				break;
+			default:
+				ok = false;
+				break;
+		}
+		
+		if (ok && store) ok = abi::checkUserPtr(va_arg(ap, void *), size, true);
+	}
+	
+	ok = ok && user_va_list(args, ap);
+	va_end(ap);
+	return ok;
+}
+
+
+
+// Open a file for an app.
+static FILE *abi_fopen(const char *path, const char *mode) {
+	if (!user_str(path) || !user_str(mode)) return nullptr;
+	return user_file_add(fopen(path, mode));
+}
+
+// Reopen a file for an app.
+static FILE *abi_freopen(const char *path, const char *mode, FILE *fd) {
+	if ((path && !user_str(path)) || !user_str(mode) || !user_file(fd)) return nullptr;
+	user_file_remove(fd);
+	return user_file_add(freopen(path, mode, fd));
+}
+
+// Close a file opened by an app.
+static int abi_fclose(FILE *fd) {
+	if (!user_file(fd)) return EOF;
+	user_file_remove(fd);
+	return fclose(fd);
+}
+
+// Change the buffering of a file.
+// User buffers are refused; the file would keep using them after the app unmaps them.
+static int abi_setvbuf(FILE *fd, char *buf, int mode, size_t size) {
+	if (!user_file(fd) || buf) return EOF;
+	return setvbuf(fd, nullptr, mode, size);
+}
+
+// Formatted write to a file.
+static int abi_vfprintf(FILE *fd, const char *fmt, va_list args) {
+	if (!user_file(fd) || !check_printf(fmt, args)) return -1;
+	return vfprintf(fd, fmt, args);
+}
+
+// Formatted write to a file.
+static int abi_fprintf(FILE *fd, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vfprintf(fd, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted write to stdout.
+static int abi_vprintf(const char *fmt, va_list args) {
+	return abi_vfprintf(stdout, fmt, args);
+}
+
+// Formatted write to stdout.
+static int abi_printf(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vfprintf(stdout, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Fortified formatted write to stdout.
+static int abi___printf_chk(int flag, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vfprintf(stdout, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted write to a bounded user buffer.
+static int abi_vsnprintf(char *buf, size_t size, const char *fmt, va_list args) {
+	if ((size && !abi::checkUserPtr(buf, size, true)) || !check_printf(fmt, args)) return -1;
+	return vsnprintf(buf, size, fmt, args);
+}
+
+// Formatted write to a bounded user buffer.
+static int abi_snprintf(char *buf, size_t size, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vsnprintf(buf, size, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted write to a user buffer, which must fit the entire output.
+static int abi_vsprintf(char *buf, const char *fmt, va_list args) {
+	if (!check_printf(fmt, args)) return -1;
+	va_list tmp;
+	va_copy(tmp, args);
+	int len = vsnprintf(nullptr, 0, fmt, tmp);
+	va_end(tmp);
+	if (len < 0 || !abi::checkUserPtr(buf, len + 1, true)) return -1;
+	return vsprintf(buf, fmt, args);
+}
+
+// Formatted write to a user buffer, which must fit the entire output.
+static int abi_sprintf(char *buf, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vsprintf(buf, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted write to a newly allocated string.
+static int abi_vasprintf(char **out, const char *fmt, va_list args) {
+	if (!user_opt(out) || !out || !check_printf(fmt, args)) return -1;
+	return vasprintf(out, fmt, args);
+}
+
+// Formatted write to a newly allocated string.
+static int abi_asprintf(char **out, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vasprintf(out, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted read from a file.
+static int abi_vfscanf(FILE *fd, const char *fmt, va_list args) {
+	if (!user_file(fd) || !check_scanf(fmt, args)) return EOF;
+	return vfscanf(fd, fmt, args);
+}
+
+// Formatted read from a file.
+static int abi_fscanf(FILE *fd, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vfscanf(fd, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted read from stdin.
+static int abi_vscanf(const char *fmt, va_list args) {
+	return abi_vfscanf(stdin, fmt, args);
+}
+
+// Formatted read from stdin.
+static int abi_scanf(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vfscanf(stdin, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Formatted read from a user string.
+static int abi_vsscanf(const char *str, const char *fmt, va_list args) {
+	if (!user_str(str) || !check_scanf(fmt, args)) return EOF;
+	return vsscanf(str, fmt, args);
+}
+
+// Formatted read from a user string.
+static int abi_sscanf(const char *str, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int res = abi_vsscanf(str, fmt, args);
+	va_end(args);
+	return res;
+}
+
+// Read a line from a file into a user buffer.
+static char *abi_fgets(char *buf, int size, FILE *fd) {
+	if (size <= 0 || !abi::checkUserPtr(buf, size, true) || !user_file(fd)) return nullptr;
+	return fgets(buf, size, fd);
+}
+
+// Read from a file into a user buffer.
+static size_t abi_fread(void *ptr, size_t size, size_t count, FILE *fd) {
+	if (size && count > SIZE_MAX / size) return 0;
+	if (!abi::checkUserPtr(ptr, size * count, true) || !user_file(fd)) return 0;
+	return fread(ptr, size, count, fd);
+}
+
+// Write to a file from a user buffer.
+static size_t abi_fwrite(const void *ptr, size_t size, size_t count, FILE *fd) {
+	if (size && count > SIZE_MAX / size) return 0;
+	if (!abi::checkUserPtr(ptr, size * count) || !user_file(fd)) return 0;
+	return fwrite(ptr, size, count, fd);
+}
+
+// Convert a user string to a double.
+static double abi_strtod(const char *str, char **end) {
+	if (!user_str(str) || !user_opt(end)) return 0;
+	return strtod(str, end);
+}
+
+// Convert a user string to a long.
+static long abi_strtol(const char *str, char **end, int base) {
+	if (!user_str(str) || !user_opt(end)) return 0;
+	return strtol(str, end, base);
+}
+
+// Convert a user string to an unsigned long.
+static unsigned long abi_strtoul(const char *str, char **end, int base) {
+	if (!user_str(str) || !user_opt(end)) return 0;
+	return strtoul(str, end, base);
+}
+
+
+
+// Search a user buffer for a byte, up to the end of its mapping.
+static void *abi_memchr(const void *ptr, int value, size_t len) {
+	return (void *) memchr(ptr, value, std::min(len, abi::userSpan(ptr)));
+}
+
+// Search a user buffer backwards for a byte.
+static void *abi_memrchr(const void *ptr, int value, size_t len) {
+	if (!abi::checkUserPtr(ptr, len)) return nullptr;
+	return (void *) memrchr(ptr, value, len);
+}
+
+// Compare user buffers; invalid ones compare unequal.
+static int abi_memcmp(const void *a, const void *b, size_t len) {
+	if (!abi::checkUserPtr(a, len) || !abi::checkUserPtr(b, len)) return 1;
+	return memcmp(a, b, len);
+}
+
+// Copy memory between user buffers up to and including the first `value`.
+static void *abi_memccpy(void *dst, const void *src, int value, size_t len) {
+	size_t span = std::min(len, abi::userSpan(src));
+	auto   hit  = (const char *) memchr(src, value, span);
+	if (!hit && span < len) return nullptr;
+	size_t count = hit ? hit - (const char *) src + 1 : len;
+	if (!abi::checkUserPtr(dst, count, true)) return nullptr;
+	return memccpy(dst, src, value, len);
+}
+
+// Copy memory between user buffers.
+static void *abi_memcpy(void *dst, const void *src, size_t len) {
+	if (!abi::checkUserPtr(dst, len, true) || !abi::checkUserPtr(src, len)) return dst;
+	return memcpy(dst, src, len);
+}
+
+// Move memory between user buffers.
+static void *abi_memmove(void *dst, const void *src, size_t len) {
+	if (!abi::checkUserPtr(dst, len, true) || !abi::checkUserPtr(src, len)) return dst;
+	return memmove(dst, src, len);
+}
+
+// Fill a user buffer.
+static void *abi_memset(void *dst, int value, size_t len) {
+	if (!abi::checkUserPtr(dst, len, true)) return dst;
+	return memset(dst, value, len);
+}
+
+// Find the first occurrence of a character in a user string.
+static char *abi_strchr(const char *str, int value) {
+	if (!user_str(str)) return nullptr;
+	return (char *) strchr(str, value);
+}
+
+// Find the last occurrence of a character in a user string.
+static char *abi_strrchr(const char *str, int value) {
+	if (!user_str(str)) return nullptr;
+	return (char *) strrchr(str, value);
+}
+
+// Compare user strings; invalid ones compare unequal.
+static int abi_strcmp(const char *a, const char *b) {
+	if (!user_str(a) || !user_str(b)) return 1;
+	return strcmp(a, b);
+}
+
+// Compare at most `max` characters of user strings; invalid ones compare unequal.
+static int abi_strncmp(const char *a, const char *b, size_t max) {
+	size_t alen, blen;
+	if (!user_strnlen(a, max, alen) || !user_strnlen(b, max, blen)) return 1;
+	return strncmp(a, b, max);
+}
+
+// Append a user string to another.
+static char *abi_strcat(char *dst, const char *src) {
+	size_t dlen, slen;
+	if (!user_strnlen(dst, SIZE_MAX, dlen) || !user_strnlen(src, SIZE_MAX, slen)) return dst;
+	if (!abi::checkUserPtr(dst + dlen, slen + 1, true)) return dst;
+	return strcat(dst, src);
+}
+
+// Append at most `max` characters of a user string to another.
+static char *abi_strncat(char *dst, const char *src, size_t max) {
+	size_t dlen, slen;
+	if (!user_strnlen(dst, SIZE_MAX, dlen) || !user_strnlen(src, max, slen)) return dst;
+	if (!abi::checkUserPtr(dst + dlen, slen + 1, true)) return dst;
+	return strncat(dst, src, max);
+}
+
+// Measure the prefix of a user string made of characters in `set`.
+static size_t abi_strspn(const char *str, const char *set) {
+	if (!user_str(str) || !user_str(set)) return 0;
+	return strspn(str, set);
+}
+
+// Measure the prefix of a user string made of characters not in `set`.
+static size_t abi_strcspn(const char *str, const char *set) {
+	if (!user_str(str) || !user_str(set)) return 0;
+	return strcspn(str, set);
+}
+
+// Find a user string in another.
+static char *abi_strstr(const char *str, const char *find) {
+	if (!user_str(str) || !user_str(find)) return nullptr;
+	return (char *) strstr(str, find);
+}
+
+// Find a user string in another, ignoring case.
+static char *abi_strcasestr(const char *str, const char *find) {
+	if (!user_str(str) || !user_str(find)) return nullptr;
+	return (char *) strcasestr(str, find);
+}
+
+// Measure a user string; 0 if it is not terminated within its mapping.
+static size_t abi_strlen(const char *str) {
+	size_t len;
+	return user_strnlen(str, SIZE_MAX, len) ? len : 0;
+}
+
+// Measure a user string of at most `max` characters; 0 if it runs past its mapping first.
+static size_t abi_strnlen(const char *str, size_t max) {
+	size_t len;
+	return user_strnlen(str, max, len) ? len : 0;
+}
+
+// Pure functions from string.h and their checked versions for when they run in M-mode.
+static const struct {
+	const char *name;
+	size_t      direct;
+	size_t      checked;
+} pureExports[] = {
+	{ "memchr",     (size_t) &memchr,     (size_t) &abi_memchr     },
+	{ "memrchr",    (size_t) &memrchr,    (size_t) &abi_memrchr    },
+	{ "memcmp",     (size_t) &memcmp,     (size_t) &abi_memcmp     },
+	{ "memccpy",    (size_t) &memccpy,    (size_t) &abi_memccpy    },
+	{ "memcpy",     (size_t) &memcpy,     (size_t) &abi_memcpy     },
+	{ "memmove",    (size_t) &memmove,    (size_t) &abi_memmove    },
+	{ "memset",     (size_t) &memset,     (size_t) &abi_memset     },
+	{ "strchr",     (size_t) &strchr,     (size_t) &abi_strchr     },
+	{ "strrchr",    (size_t) &strrchr,    (size_t) &abi_strrchr    },
+	{ "strcmp",     (size_t) &strcmp,     (size_t) &abi_strcmp     },
+	{ "strncmp",    (size_t) &strncmp,    (size_t) &abi_strncmp    },
+	{ "strcat",     (size_t) &strcat,     (size_t) &abi_strcat     },
+	{ "strncat",    (size_t) &strncat,    (size_t) &abi_strncat    },
+	{ "strspn",     (size_t) &strspn,     (size_t) &abi_strspn     },
+	{ "strcspn",    (size_t) &strcspn,    (size_t) &abi_strcspn    },
+	{ "strstr",     (size_t) &strstr,     (size_t) &abi_strstr     },
+	{ "strcasestr", (size_t) &strcasestr, (size_t) &abi_strcasestr },
+	{ "strlen",     (size_t) &strlen,     (size_t) &abi_strlen     },
+	{ "strnlen",    (size_t) &strnlen,    (size_t) &abi_strnlen    },
+};
+
+
 // Exports ABI symbols into `map` (no wrapper).
 void abi::libc::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// No header file:
@@ -69,64 +685,65 @@ void abi::libc::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// map["realloc"] = (size_t) &realloc;
 	
 	// From stdio.h:
+	// Everything here runs in M-mode, so pointers from apps are checked.
 	map["__get_stdin"]  = (size_t) +[]{ return stdin; };
 	map["__get_stdout"] = (size_t) +[]{ return stdout; };
 	map["__get_stderr"] = (size_t) +[]{ return stderr; };
-	map["__printf_chk"] = (size_t) &printf;
+	map["__printf_chk"] = (size_t) &abi___printf_chk;
 	
-	map["remove"]    = (size_t) &remove;
-	map["rename"]    = (size_t) &rename;
-	map["tmpfile"]   = (size_t) &tmpfile;
-	map["tmpnam"]    = (size_t) &tmpnam;
-	map["fclose"]    = (size_t) &fclose;
-	map["fflush"]    = (size_t) &fflush;
-	map["fopen"]     = (size_t) &fopen;
-	map["freopen"]   = (size_t) &freopen;
-	map["vfprintf"]  = (size_t) &vfprintf;
-	map["fprintf"]   = (size_t) &fprintf;
-	map["vprintf"]   = (size_t) &vprintf;
-	map["printf"]    = (size_t) &printf;
-	map["vasprintf"] = (size_t) &vasprintf;
-	map["asprintf"]  = (size_t) &asprintf;
-	map["vsnprintf"] = (size_t) &vsnprintf;
-	map["vsprintf"]  = (size_t) &vsprintf;
-	map["snprintf"]  = (size_t) &snprintf;
-	map["sprintf"]   = (size_t) &sprintf;
-	map["vfscanf"]   = (size_t) &vfscanf;
-	map["fscanf"]    = (size_t) &fscanf;
-	map["vscanf"]    = (size_t) &vscanf;
-	map["scanf"]     = (size_t) &scanf;
-	map["vsscanf"]   = (size_t) &vsscanf;
-	map["sscanf"]    = (size_t) &sscanf;
-	map["fgets"]     = (size_t) &fgets;
-	map["fgetc"]     = (size_t) &fgetc;
+	map["remove"]    = (size_t) +[](const char *path) { return user_str(path) ? remove(path) : -1; };
+	map["rename"]    = (size_t) +[](const char *from, const char *to) { return user_str(from) && user_str(to) ? rename(from, to) : -1; };
+	map["tmpfile"]   = (size_t) +[]{ return user_file_add(tmpfile()); };
+	map["tmpnam"]    = (size_t) +[](char *buf) { return !buf || abi::checkUserPtr(buf, L_tmpnam, true) ? tmpnam(buf) : nullptr; };
+	map["fclose"]    = (size_t) &abi_fclose;
+	map["fflush"]    = (size_t) +[](FILE *fd) { return !fd || user_file(fd) ? fflush(fd) : EOF; };
+	map["fopen"]     = (size_t) &abi_fopen;
+	map["freopen"]   = (size_t) &abi_freopen;
+	map["vfprintf"]  = (size_t) &abi_vfprintf;
+	map["fprintf"]   = (size_t) &abi_fprintf;
+	map["vprintf"]   = (size_t) &abi_vprintf;
+	map["printf"]    = (size_t) &abi_printf;
+	map["vasprintf"] = (size_t) &abi_vasprintf;
+	map["asprintf"]  = (size_t) &abi_asprintf;
+	map["vsnprintf"] = (size_t) &abi_vsnprintf;
+	map["vsprintf"]  = (size_t) &abi_vsprintf;
+	map["snprintf"]  = (size_t) &abi_snprintf;
+	map["sprintf"]   = (size_t) &abi_sprintf;
+	map["vfscanf"]   = (size_t) &abi_vfscanf;
+	map["fscanf"]    = (size_t) &abi_fscanf;
+	map["vscanf"]    = (size_t) &abi_vscanf;
+	map["scanf"]     = (size_t) &abi_scanf;
+	map["vsscanf"]   = (size_t) &abi_vsscanf;
+	map["sscanf"]    = (size_t) &abi_sscanf;
+	map["fgets"]     = (size_t) &abi_fgets;
+	map["fgetc"]     = (size_t) +[](FILE *fd) { return user_file(fd) ? fgetc(fd) : EOF; };
 	map["getchar"]   = (size_t) &getchar;
-	map["fread"]     = (size_t) &fread;
-	map["ungetc"]    = (size_t) &ungetc;
-	map["fputs"]     = (size_t) &fputs;
-	map["puts"]      = (size_t) &puts;
-	map["fputc"]     = (size_t) &fputc;
+	map["fread"]     = (size_t) &abi_fread;
+	map["ungetc"]    = (size_t) +[](int c, FILE *fd) { return user_file(fd) ? ungetc(c, fd) : EOF; };
+	map["fputs"]     = (size_t) +[](const char *str, FILE *fd) { return user_str(str) && user_file(fd) ? fputs(str, fd) : EOF; };
+	map["puts"]      = (size_t) +[](const char *str) { return user_str(str) ? puts(str) : EOF; };
+	map["fputc"]     = (size_t) +[](int c, FILE *fd) { return user_file(fd) ? fputc(c, fd) : EOF; };
 	map["putchar"]   = (size_t) &putchar;
-	map["fwrite"]    = (size_t) &fwrite;
-	map["fgetpos"]   = (size_t) &fgetpos;
-	map["fsetpos"]   = (size_t) &fsetpos;
-	map["fseek"]     = (size_t) &fseek;
-	map["ftell"]     = (size_t) &ftell;
-	map["rewind"]    = (size_t) &rewind;
-	map["setbuf"]    = (size_t) &setbuf;
-	map["setvbuf"]   = (size_t) &setvbuf;
-	map["clearerr"]  = (size_t) &clearerr;
-	map["feof"]      = (size_t) &feof;
-	map["ferror"]    = (size_t) &ferror;
-	map["perror"]    = (size_t) &perror;
+	map["fwrite"]    = (size_t) &abi_fwrite;
+	map["fgetpos"]   = (size_t) +[](FILE *fd, fpos_t *pos) { return user_file(fd) && pos && user_opt(pos) ? fgetpos(fd, pos) : -1; };
+	map["fsetpos"]   = (size_t) +[](FILE *fd, const fpos_t *pos) { return user_file(fd) && pos && user_opt(pos) ? fsetpos(fd, pos) : -1; };
+	map["fseek"]     = (size_t) +[](FILE *fd, long off, int whence) { return user_file(fd) ? fseek(fd, off, whence) : -1; };
+	map["ftell"]     = (size_t) +[](FILE *fd) { return user_file(fd) ? ftell(fd) : -1L; };
+	map["rewind"]    = (size_t) +[](FILE *fd) { if (user_file(fd)) rewind(fd); };
+	map["setbuf"]    = (size_t) +[](FILE *fd, char *buf) { abi_setvbuf(fd, nullptr, buf ? _IOFBF : _IONBF, BUFSIZ); };
+	map["setvbuf"]   = (size_t) &abi_setvbuf;
+	map["clearerr"]  = (size_t) +[](FILE *fd) { if (user_file(fd)) clearerr(fd); };
+	map["feof"]      = (size_t) +[](FILE *fd) { return user_file(fd) ? feof(fd) : 0; };
+	map["ferror"]    = (size_t) +[](FILE *fd) { return user_file(fd) ? ferror(fd) : 0; };
+	map["perror"]    = (size_t) +[](const char *str) { if (!str || user_str(str)) perror(str); };
 	
 	// From stdlib.h:
-	map["atof"]    = (size_t) &atof;
-	map["atoi"]    = (size_t) &atoi;
-	map["atol"]    = (size_t) &atol;
-	map["strtod"]  = (size_t) &strtod;
-	map["strtol"]  = (size_t) &strtol;
-	map["strtoul"] = (size_t) &strtoul;
+	map["atof"]    = (size_t) +[](const char *str) { return user_str(str) ? atof(str) : 0.0; };
+	map["atoi"]    = (size_t) +[](const char *str) { return user_str(str) ? atoi(str) : 0; };
+	map["atol"]    = (size_t) +[](const char *str) { return user_str(str) ? atol(str) : 0L; };
+	map["strtod"]  = (size_t) &abi_strtod;
+	map["strtol"]  = (size_t) &abi_strtol;
+	map["strtoul"] = (size_t) &abi_strtoul;
 	map["rand"]    = (size_t) &rand;
 	map["srand"]   = (size_t) &srand;
 	map["abort"]   = (size_t) &appAborted;
@@ -135,24 +752,17 @@ void abi::libc::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// `getenv` is up to the program itself to implement.
 	
 	// From string.h:
-	map["memchr"]     = (size_t) &memchr;
-	map["memrchr"]    = (size_t) &memrchr;
-	map["memcmp"]     = (size_t) &memcmp;
-	map["memccpy"]    = (size_t) &memccpy;
-	map["memcpy"]     = (size_t) &memcpy;
-	map["memmove"]    = (size_t) &memmove;
-	map["memset"]     = (size_t) &memset;
-	map["strchr"]     = (size_t) &strchr;
-	map["strrchr"]    = (size_t) &strrchr;
-	map["strcmp"]     = (size_t) &strcmp;
-	map["strncmp"]    = (size_t) &strncmp;
-	map["strcat"]     = (size_t) &strcat;
-	map["strncat"]    = (size_t) &strncat;
-	map["strspn"]     = (size_t) &strspn;
-	map["strcspn"]    = (size_t) &strcspn;
-	map["strstr"]     = (size_t) &strstr;
-	map["strcasestr"] = (size_t) &strcasestr;
-	map["strlen"]     = (size_t) &strlen;
-	map["strnlen"]    = (size_t) &strnlen;
-	map["strerror"]   = (size_t) &strerror;
+	// These are linked directly if U-mode can call them, otherwise they run in M-mode and check their buffers.
+	for (const auto &func: pureExports) {
+		map[func.name] = abi::directlyCallable(func.direct) ? func.direct : func.checked;
+	}
+	map["strerror"] = (size_t) &strerror;
+}
+
+// Exports trust classes of ABI symbols into `map`.
+void abi::libc::exportTrust(TrustMap &map) {
+	// From string.h, except `strerror` which returns kernel memory.
+	for (const auto &func: pureExports) {
+		if (abi::directlyCallable(func.direct)) map[func.name] = Trust::PURE;
+	}
 }
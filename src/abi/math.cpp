@@ -24,6 +24,8 @@
 
 #include "math.hpp"
 
+#include <abi.hpp>
+
 extern "C" {
 double acos(double x);
 double asin(double x);
@@ -67,6 +69,35 @@ float floorf(float x);
 float fmodf(float x, float y);
 }
 
+// Split a double into a normalized fraction and a user exponent.
+static double abi_frexp(double x, int *exponent) {
+	if (!abi::checkUserPtr(exponent, sizeof(int), true)) return x;
+	return frexp(x, exponent);
+}
+
+// Split a double into user integer part and a fraction.
+static double abi_modf(double x, double *integer) {
+	if (!abi::checkUserPtr(integer, sizeof(double), true)) return x;
+	return modf(x, integer);
+}
+
+// Split a float into a normalized fraction and a user exponent.
+static float abi_frexpf(float x, int *exponent) {
+	if (!abi::checkUserPtr(exponent, sizeof(int), true)) return x;
+	return frexpf(x, exponent);
+}
+
+// Split a float into user integer part and a fraction.
+static float abi_modff(float x, float *integer) {
+	if (!abi::checkUserPtr(integer, sizeof(float), true)) return x;
+	return modff(x, integer);
+}
+
+// Link a pure function directly if U-mode can call it, otherwise its checked version.
+static size_t pure(size_t direct, size_t checked) {
+	return abi::directlyCallable(direct) ? direct : checked;
+}
+
 // Exports ABI symbols into `map` (no wrapper).
 void abi::math::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// From math.h:
@@ -81,10 +112,10 @@ void abi::math::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["sinh"] = (size_t) &sinh;
 	map["tanh"] = (size_t) &tanh;
 	map["exp"] = (size_t) &exp;
-	map["frexp"] = (size_t) &frexp;
+	map["frexp"] = pure((size_t) &frexp, (size_t) &abi_frexp);
 	map["log"] = (size_t) &log;
 	map["log10"] = (size_t) &log10;
-	map["modf"] = (size_t) &modf;
+	map["modf"] = pure((size_t) &modf, (size_t) &abi_modf);
 	map["pow"] = (size_t) &pow;
 	map["sqrt"] = (size_t) &sqrt;
 	map["ceil"] = (size_t) &ceil;
@@ -101,13 +132,27 @@ void abi::math::exportSymbolsUnwrapped(elf::SymMap &map) {
 	map["sinhf"] = (size_t) &sinhf;
 	map["tanhf"] = (size_t) &tanhf;
 	map["expf"] = (size_t) &expf;
-	map["frexpf"] = (size_t) &frexpf;
+	map["frexpf"] = pure((size_t) &frexpf, (size_t) &abi_frexpf);
 	map["logf"] = (size_t) &logf;
 	map["log10f"] = (size_t) &log10f;
-	map["modff"] = (size_t) &modff;
+	map["modff"] = pure((size_t) &modff, (size_t) &abi_modff);
 	map["powf"] = (size_t) &powf;
 	map["sqrtf"] = (size_t) &sqrtf;
 	map["ceilf"] = (size_t) &ceilf;
 	map["floorf"] = (size_t) &floorf;
 	map["fmodf"] = (size_t) &fmodf;
 }
+
+// Exports trust classes of ABI symbols into `map`.
+void abi::math::exportTrust(TrustMap &map) {
+	// Functions that can report domain or range errors write `errno`,
+	// which lives in kernel memory, so only these are pure.
+	for (const char *name: { "ceil", "floor", "ceilf", "floorf" }) {
+		map[name] = Trust::PURE;
+	}
+	// These write through a pointer, so they're only pure where U-mode can call them directly.
+	if (abi::directlyCallable((size_t) &modf))   map["modf"]   = Trust::PURE;
+	if (abi::directlyCallable((size_t) &frexp))  map["frexp"]  = Trust::PURE;
+	if (abi::directlyCallable((size_t) &modff))  map["modff"]  = Trust::PURE;
+	if (abi::directlyCallable((size_t) &frexpf)) map["frexpf"] = Trust::PURE;
+}
@@ -25,10 +25,13 @@
 #pragma once
 
 #include <elfloader.hpp>
+#include "trust.hpp"
 
 namespace abi::math {
 
 // Exports ABI symbols into `map` (no wrapper).
 void exportSymbolsUnwrapped(elf::SymMap &map);
+// Exports trust classes of ABI symbols into `map`.
+void exportTrust(TrustMap &map);
 
 }
@@ -0,0 +1,233 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "pixfmt.hpp"
+
+#include <string.h>
+
+// Pixel format conversion kernels.
+// Aligned rows are processed a 32-bit word at a time: two RGB565 pixels per word,
+// or four RGB888 pixels per three words.
+
+// Ordered dithering thresholds.
+static const uint8_t bayer4[4][4] = {
+	{   8, 136,  40, 168 },
+	{ 200,  72, 232, 104 },
+	{  56, 184,  24, 152 },
+	{ 248, 120, 216,  88 },
+};
+
+// Swap the bytes of both halves of a word.
+static inline uint32_t swap16x2(uint32_t word) {
+	return ((word & 0x00ff00ff) << 8) | ((word >> 8) & 0x00ff00ff);
+}
+
+// Convert red, green and blue bytes to RGB565.
+static inline uint32_t pack565(uint32_t r, uint32_t g, uint32_t b) {
+	return ((r & 0xf8) << 8) | ((g & 0xfc) << 3) | ((b & 0xf8) >> 3);
+}
+
+// Convert an `0xAARRGGBB` word to RGB565.
+static inline uint32_t argbTo565(uint32_t p) {
+	return ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f);
+}
+
+// Get the luminance of an RGB565 pixel.
+static inline uint32_t luma565(uint32_t p) {
+	uint32_t r = (p >> 8) & 0xf8, g = (p >> 3) & 0xfc, b = (p << 3) & 0xf8;
+	return (r * 77 + g * 150 + b * 29) >> 8;
+}
+
+// Get the luminance of red, green and blue bytes.
+static inline uint32_t luma888(uint32_t r, uint32_t g, uint32_t b) {
+	return (r * 77 + g * 150 + b * 29) >> 8;
+}
+
+// Whether all pointers are word-aligned.
+static inline bool aligned(const void *a, const void *b) {
+	return (((size_t) a | (size_t) b) & 3) == 0;
+}
+
+// Convert RGB565 with swapped byte order.
+static void swap565(uint8_t *dst, const uint8_t *src, int width) {
+	int i = 0;
+	if (aligned(dst, src)) {
+		for (; i + 2 <= width; i += 2) {
+			*(uint32_t *) (dst + i * 2) = swap16x2(*(const uint32_t *) (src + i * 2));
+		}
+	}
+	for (; i < width; i++) {
+		dst[i * 2]     = src[i * 2 + 1];
+		dst[i * 2 + 1] = src[i * 2];
+	}
+}
+
+// Convert RGB888 to RGB565.
+static void rgb888To565(uint8_t *dst, const uint8_t *src, int width, bool bigEndian) {
+	int i = 0;
+	if (aligned(dst, src)) {
+		for (; i + 4 <= width; i += 4) {
+			// Bytes R0 G0 B0 R1 | G1 B1 R2 G2 | B2 R3 G3 B3.
+			auto in = (const uint32_t *) (src + i * 3);
+			uint32_t w0 = in[0], w1 = in[1], w2 = in[2];
+			uint32_t p0 = pack565(w0,       w0 >> 8,  w0 >> 16);
+			uint32_t p1 = pack565(w0 >> 24, w1,       w1 >> 8);
+			uint32_t p2 = pack565(w1 >> 16, w1 >> 24, w2);
+			uint32_t p3 = pack565(w2 >> 8,  w2 >> 16, w2 >> 24);
+			uint32_t o0 = p0 | (p1 << 16), o1 = p2 | (p3 << 16);
+			if (bigEndian) {
+				o0 = swap16x2(o0);
+				o1 = swap16x2(o1);
+			}
+			auto out = (uint32_t *) (dst + i * 2);
+			out[0] = o0;
+			out[1] = o1;
+		}
+	}
+	for (; i < width; i++) {
+		uint32_t p = pack565(src[i * 3], src[i * 3 + 1], src[i * 3 + 2]);
+		dst[i * 2 + !bigEndian] = p >> 8;
+		dst[i * 2 +  bigEndian] = p;
+	}
+}
+
+// Convert ARGB8888 to RGB565.
+static void argbTo565Row(uint8_t *dst, const uint8_t *src, int width, bool bigEndian) {
+	int i = 0;
+	if (aligned(dst, src)) {
+		auto in = (const uint32_t *) src;
+		for (; i + 2 <= width; i += 2) {
+			uint32_t o = argbTo565(in[i]) | (argbTo565(in[i + 1]) << 16);
+			*(uint32_t *) (dst + i * 2) = bigEndian ? swap16x2(o) : o;
+		}
+	}
+	for (; i < width; i++) {
+		uint32_t p;
+		memcpy(&p, src + i * 4, 4);
+		p = argbTo565(p);
+		dst[i * 2 + !bigEndian] = p >> 8;
+		dst[i * 2 +  bigEndian] = p;
+	}
+}
+
+// Get the luminance of pixel `i` of a row.
+static inline uint32_t lumaAt(const uint8_t *src, display_fmt_t from, int i) {
+	switch (from) {
+		case DISPLAY_FMT_RGB565_LE: return luma565(src[i * 2] | (src[i * 2 + 1] << 8));
+		case DISPLAY_FMT_RGB565_BE: return luma565((src[i * 2] << 8) | src[i * 2 + 1]);
+		case DISPLAY_FMT_RGB888:    return luma888(src[i * 3], src[i * 3 + 1], src[i * 3 + 2]);
+		default: {
+			uint32_t p;
+			memcpy(&p, src + i * 4, 4);
+			return luma888((p >> 16) & 0xff, (p >> 8) & 0xff, p & 0xff);
+		}
+	}
+}
+
+// Convert to 1 bit per pixel with ordered dithering.
+static void toMono(uint8_t *dst, const uint8_t *src, display_fmt_t from, int width, int x, int y) {
+	const uint8_t *thres = bayer4[y & 3];
+	memset(dst, 0, (width + 7) / 8);
+	if (from == DISPLAY_FMT_RGB565_LE && ((size_t) src & 3) == 0) {
+		// Two pixels per word.
+		auto in = (const uint32_t *) src;
+		int i = 0;
+		for (; i + 2 <= width; i += 2) {
+			uint32_t w = in[i / 2];
+			if (luma565(w & 0xffff) > thres[(x + i) & 3])     dst[i / 8]       |= 0x80 >> (i & 7);
+			if (luma565(w >> 16)    > thres[(x + i + 1) & 3]) dst[(i + 1) / 8] |= 0x80 >> ((i + 1) & 7);
+		}
+		if (i < width && luma565(((const uint16_t *) src)[i]) > thres[(x + i) & 3]) {
+			dst[i / 8] |= 0x80 >> (i & 7);
+		}
+		return;
+	}
+	for (int i = 0; i < width; i++) {
+		if (lumaAt(src, from, i) > thres[(x + i) & 3]) dst[i / 8] |= 0x80 >> (i & 7);
+	}
+}
+
+// Convert to 2 bits per pixel with ordered dithering.
+static void toGrey2(uint8_t *dst, const uint8_t *src, display_fmt_t from, int width, int x, int y) {
+	const uint8_t *thres = bayer4[y & 3];
+	memset(dst, 0, (width + 3) / 4);
+	for (int i = 0; i < width; i++) {
+		// Three steps between four levels; the fraction of a step selects rounding up.
+		uint32_t level = lumaAt(src, from, i) * 3;
+		uint32_t grey  = (level >> 8) + ((level & 0xff) > thres[(x + i) & 3]);
+		dst[i / 4] |= grey << (6 - (i & 3) * 2);
+	}
+}
+
+// Get the size in bytes of one row of `width` pixels.
+// Returns 0 for `DISPLAY_FMT_RAW` or unknown formats.
+size_t abi::pixfmt::rowSize(display_fmt_t fmt, int width) {
+	switch (fmt) {
+		case DISPLAY_FMT_RGB565_BE:
+		case DISPLAY_FMT_RGB565_LE: return width * 2;
+		case DISPLAY_FMT_RGB888:    return width * 3;
+		case DISPLAY_FMT_ARGB8888:  return width * 4;
+		case DISPLAY_FMT_MONO:      return (width + 7) / 8;
+		case DISPLAY_FMT_GREY2:     return (width + 3) / 4;
+		default: return 0;
+	}
+}
+
+// Whether several pixels share a byte.
+bool abi::pixfmt::packed(display_fmt_t fmt) {
+	return fmt == DISPLAY_FMT_MONO || fmt == DISPLAY_FMT_GREY2;
+}
+
+// Whether rows can be converted from format `from` to format `to`.
+bool abi::pixfmt::canConvert(display_fmt_t from, display_fmt_t to) {
+	if (from == to) return true;
+	if (from == DISPLAY_FMT_RAW || packed(from) || !rowSize(from, 1)) return false;
+	return to == DISPLAY_FMT_RGB565_BE || to == DISPLAY_FMT_RGB565_LE || packed(to);
+}
+
+// Convert one row of `width` pixels that starts at (`x`, `y`) on the display.
+// The position selects the dither pattern when converting to `DISPLAY_FMT_MONO` or `DISPLAY_FMT_GREY2`.
+void abi::pixfmt::convertRow(void *_dst, display_fmt_t to, const void *_src, display_fmt_t from, int width, int x, int y) {
+	auto dst = (uint8_t *) _dst;
+	auto src = (const uint8_t *) _src;
+	if (from == to) {
+		memcpy(dst, src, rowSize(from, width));
+		return;
+	}
+	if (to == DISPLAY_FMT_MONO) {
+		toMono(dst, src, from, width, x, y);
+		return;
+	} else if (to == DISPLAY_FMT_GREY2) {
+		toGrey2(dst, src, from, width, x, y);
+		return;
+	}
+	bool bigEndian = to == DISPLAY_FMT_RGB565_BE;
+	switch (from) {
+		case DISPLAY_FMT_RGB565_BE:
+		case DISPLAY_FMT_RGB565_LE: swap565(dst, src, width); break;
+		case DISPLAY_FMT_RGB888:    rgb888To565(dst, src, width, bigEndian); break;
+		case DISPLAY_FMT_ARGB8888:  argbTo565Row(dst, src, width, bigEndian); break;
+		default: break;
+	}
+}
@@ -0,0 +1,45 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include <displayabi.h>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace abi::pixfmt {
+
+// Get the size in bytes of one row of `width` pixels.
+// Returns 0 for `DISPLAY_FMT_RAW` or unknown formats.
+size_t rowSize(display_fmt_t fmt, int width);
+// Whether several pixels share a byte.
+bool packed(display_fmt_t fmt);
+// Whether rows can be converted from format `from` to format `to`.
+bool canConvert(display_fmt_t from, display_fmt_t to);
+// Convert one row of `width` pixels that starts at (`x`, `y`) on the display.
+// The position selects the dither pattern when converting to `DISPLAY_FMT_MONO` or `DISPLAY_FMT_GREY2`.
+void convertRow(void *dst, display_fmt_t to, const void *src, display_fmt_t from, int width, int x, int y);
+
+}
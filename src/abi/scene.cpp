@@ -0,0 +1,101 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "scene.hpp"
+
+#include <algorithm>
+
+#include <string.h>
+#include <stdlib.h>
+
+// Get `a` modulo `b`, always positive.
+static inline int wrap(int a, int b) {
+	a %= b;
+	return a < 0 ? a + b : a;
+}
+
+// Find a sprite by identifier.
+abi::scene::Sprite *abi::scene::Scene::find(int id) {
+	for (auto &sprite: sprites) {
+		if (sprite.id == id) return &sprite;
+	}
+	return nullptr;
+}
+
+// Set the map position at the top left of the display, modulo the size of the map.
+void abi::scene::Scene::scroll(int x, int y) {
+	scrollX = wrap(x, cols * tileW);
+	scrollY = wrap(y, rows * tileH);
+}
+
+// Render rows `y` to `y + h` of a `width` pixels wide display into `out`, whose rows are packed.
+void abi::scene::Scene::render(uint8_t *out, int width, int y, int h) const {
+	for (int i = 0; i < h; i++) {
+		renderRow(out + i * width * bpp, width, y + i);
+	}
+}
+
+// Render one row.
+void abi::scene::Scene::renderRow(uint8_t *out, int width, int y) const {
+	// Background, by doubling the filled part.
+	memcpy(out, &background, bpp);
+	for (int n = 1; n < width; n *= 2) {
+		memcpy(out + n * bpp, out, std::min(n, width - n) * bpp);
+	}
+	
+	// Tile map, one tile row segment at a time.
+	int my   = wrap(y + scrollY, rows * tileH);
+	auto row = map.data() + my / tileH * cols;
+	int ty   = my % tileH;
+	for (int x = 0; x < width;) {
+		int      mx   = wrap(x + scrollX, cols * tileW);
+		int      tx   = mx % tileW;
+		int      n    = std::min(tileW - tx, width - x);
+		uint16_t tile = row[mx / tileW];
+		if (tile < tileCount) {
+			memcpy(out + x * bpp, tiles.get() + (((size_t) tile * tileH + ty) * tileW + tx) * bpp, n * bpp);
+		}
+		x += n;
+	}
+	
+	// Sprites, copying runs of pixels that are not the key colour.
+	for (auto &sprite: sprites) {
+		if (!sprite.visible || y < sprite.y || y >= sprite.y + sprite.height) continue;
+		int x0 = std::max(0, sprite.x), x1 = std::min(width, sprite.x + sprite.width);
+		if (x0 >= x1) continue;
+		const uint8_t *src = sprite.pixels.get() + ((y - sprite.y) * sprite.width + x0 - sprite.x) * bpp;
+		uint8_t       *dst = out + x0 * bpp;
+		int            len = x1 - x0;
+		if (!sprite.keyed) {
+			memcpy(dst, src, len * bpp);
+			continue;
+		}
+		for (int i = 0; i < len;) {
+			while (i < len && !memcmp(src + i * bpp, &sprite.key, bpp)) i++;
+			int start = i;
+			while (i < len && memcmp(src + i * bpp, &sprite.key, bpp)) i++;
+			memcpy(dst + start * bpp, src + start * bpp, (i - start) * bpp);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#pragma once
+
+#include "bufptr.hpp"
+#include <sceneabi.h>
+
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace abi::scene {
+
+// A sprite drawn on top of the tile map.
+struct Sprite {
+	// Identifier returned to the app.
+	int id;
+	// Pixels, `width * height` without padding.
+	BUFPTR pixels;
+	// Size in pixels.
+	int width, height;
+	// Position on the display of its top left corner.
+	int x, y;
+	// Stacking order; higher is on top.
+	int z;
+	// Whether the sprite is drawn.
+	bool visible;
+	// Whether pixels equal to `key` are transparent.
+	bool keyed;
+	// Transparent colour, as stored in memory.
+	uint32_t key;
+};
+
+// A retained tile map with sprites, rendered one band of rows at a time.
+struct Scene {
+	// Process that owns the scene.
+	int pid;
+	// Bytes per pixel.
+	int bpp;
+	// Tiles, each `tileW * tileH` pixels without padding.
+	BUFPTR tiles;
+	// Size of a tile in pixels.
+	int tileW, tileH;
+	// Number of tiles.
+	int tileCount;
+	// Tile indices, `cols * rows`.
+	std::vector<uint16_t> map;
+	// Size of the map in tiles.
+	int cols, rows;
+	// Map position at the top left of the display, within the map.
+	int scrollX = 0, scrollY = 0;
+	// Colour shown where no tile or sprite is drawn.
+	uint32_t background = 0;
+	// Sprites, sorted by `z`.
+	std::vector<Sprite> sprites;
+	// Last sprite identifier handed out.
+	int lastId = 0;
+	
+	// Find a sprite by identifier.
+	Sprite *find(int id);
+	// Set the map position at the top left of the display, modulo the size of the map.
+	void scroll(int x, int y);
+	// Render rows `y` to `y + h` of a `width` pixels wide display into `out`, whose rows are packed.
+	void render(uint8_t *out, int width, int y, int h) const;
+	// Render one row.
+	void renderRow(uint8_t *out, int width, int y) const;
+};
+
+}
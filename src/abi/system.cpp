@@ -30,28 +30,20 @@
 #include <freertos/task.h>
 
 #include <esp_timer.h>
+#include <esp_cpu.h>
+#include <abiring.h>
+
+#include <string.h>
 
 // Yield to scheduler.
 static void abi_yield() {
-#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
-	kernel::ctx_t *ctx = kernel::getCtx();
-	vPortYield();
-	if (ctx) kernel::setCtx(ctx);
-#else
 	vPortYield();
-#endif
 }
 
 // Delay in milliseconds.
 static void abi_delay_ms(int64_t millis) {
 	if (millis <= 0) return;
-#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
-	kernel::ctx_t *ctx = kernel::getCtx();
-	vTaskDelay(pdMS_TO_TICKS(millis));
-	if (ctx) kernel::setCtx(ctx);
-#else
 	vTaskDelay(pdMS_TO_TICKS(millis));
-#endif
 }
 
 // Delay in microseconds.
@@ -60,28 +52,102 @@ static void abi_delay_us(int64_t micros) {
 	esp_rom_delay_us(micros);
 }
 
+// Do nothing, for measuring the ABI call overhead.
+static int abi_nop() {
+	return 0;
+}
+
+// Read the CPU cycle counter, which user mode can't read on the ESP32-C6.
+static uint32_t abi_cycle_count() {
+	return esp_cpu_get_cycle_count();
+}
+
 // Map in new memory.
 static void *abi_mem_map(size_t len, size_t min_align, bool allow_exec) {
 	auto ctx = abi::getContext();
-	return (void *) ctx->map(len, 1, allow_exec, min_align);
+	size_t mem = ctx->map(len, 1, allow_exec, min_align);
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+	if (mem && !abi::updatePMP(ctx)) {
+		// Out of PMP entries.
+		ctx->unmap(mem);
+		abi::updatePMP(ctx);
+		return nullptr;
+	}
+#endif
+	return (void *) mem;
 }
 
 // Unmap memory.
 static void abi_mem_unmap(void *addr) {
 	auto ctx = abi::getContext();
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	// The kernel keeps using the ABI submission ring until the process exits.
+	if (addr == kernel::getCtx()->u_abi_ring) return;
+#endif
+	if (!abi::display::releaseMemory(ctx->getPID(), (size_t) addr)) return;
+	abi::gpio::releaseMemory(ctx->getPID());
 	ctx->unmap((size_t) addr);
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+	abi::updatePMP(ctx);
+#endif
+}
+
+// Set up the ABI submission ring for batched ABI calls.
+// Returns nullptr if the kernel is disabled, since ABI calls are direct calls then.
+static abi_ring_t *abi_ring_setup(uint32_t entries) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	// Enforce entries is a power of two.
+	if (!entries || entries > ABI_RING_MAX_ENTRIES || (entries & (entries - 1))) return nullptr;
+	auto kctx = kernel::getCtx();
+	if (kctx->u_abi_ring) return nullptr;
+	
+	// Map the ring into process memory.
+	auto ctx  = abi::getContext();
+	auto ring = (abi_ring_t *) ctx->map(abi_ring_size(entries));
+	if (!ring) return nullptr;
+#ifdef CONFIG_BADGEABI_ENABLE_MPU
+	if (!abi::updatePMP(ctx)) {
+		// Out of PMP entries.
+		ctx->unmap((size_t) ring);
+		abi::updatePMP(ctx);
+		return nullptr;
+	}
+#endif
+	memset(ring, 0, abi_ring_size(entries));
+	ring->mask = entries - 1;
+	
+	kctx->u_abi_ring      = ring;
+	kctx->u_abi_ring_mask = entries - 1;
+	return ring;
+#else
+	return nullptr;
+#endif
+}
+
+// Get the ABI index to use in the ABI submission ring.
+// Returns -1 if the kernel is disabled or there is no such function.
+static int abi_ring_index(const char *name) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	return abi::getAbiIndex(name);
+#else
+	return -1;
+#endif
 }
 
 // Exports ABI symbols into `map` (no wrapper).
 void abi::system::exportSymbolsUnwrapped(elf::SymMap &map) {
 	// From system.h:
-	map["yield"]       = (size_t) &abi_yield;
-	map["delay_ms"]    = (size_t) &abi_delay_ms;
-	map["delay_us"]    = (size_t) &abi_delay_us;
-	map["uptime_ms"]   = (size_t) +[]() -> int64_t { return esp_timer_get_time() / 1000; };
-	map["uptime_us"]   = (size_t) &esp_timer_get_time;
-	map["sched_yield"] = (size_t) &abi_yield;
-	map["usleep"]      = (size_t) &abi_delay_us;
-	map["__mem_map"]   = (size_t) &abi_mem_map;
-	map["__mem_unmap"] = (size_t) &abi_mem_unmap;
+	map["yield"]            = (size_t) &abi_yield;
+	map["delay_ms"]         = (size_t) &abi_delay_ms;
+	map["delay_us"]         = (size_t) &abi_delay_us;
+	map["uptime_ms"]        = (size_t) +[]() -> int64_t { return esp_timer_get_time() / 1000; };
+	map["uptime_us"]        = (size_t) &esp_timer_get_time;
+	map["sched_yield"]      = (size_t) &abi_yield;
+	map["usleep"]           = (size_t) &abi_delay_us;
+	map["__mem_map"]        = (size_t) &abi_mem_map;
+	map["__mem_unmap"]      = (size_t) &abi_mem_unmap;
+	map["__abi_ring_setup"] = (size_t) &abi_ring_setup;
+	map["__abi_ring_index"] = (size_t) &abi_ring_index;
+	map["__abi_nop"]        = (size_t) &abi_nop;
+	map["__cycle_count"]    = (size_t) &abi_cycle_count;
 }
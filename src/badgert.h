@@ -29,6 +29,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "displayabi.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -52,6 +54,29 @@ void badgert_add_search_dir(const char *path);
 // Remove a dynamic library search directory.
 void badgert_remove_search_dir(const char *path);
 
+// Enable or disable the kernel trace buffer.
+// Returns false if the kernel is not enabled.
+bool badgert_trace_enable(bool enable);
+// Discard all events in the kernel trace buffer.
+void badgert_trace_clear();
+// Write the kernel trace buffer to a file, to be converted by `tools/ktrace2json.py`.
+// Returns success status.
+bool badgert_trace_dump(FILE *fd);
+
+// Start the ABI call benchmark app built into the firmware with CONFIG_BADGEABI_BENCH.
+// Results are printed for `tools/benchcmp.py` to compare against a baseline.
+// Returns false if there is no built-in benchmark app or it could not be started.
+bool badgert_bench();
+
+// Measure interrupt latency from a timer alarm to its ISR, printing the result in CPU cycles.
+// Run once idle and once while an app is running to compare both cases.
+// Returns success status.
+bool badgert_irq_latency(size_t samples);
+
+// Get the performance counters of a display, optionally resetting them afterwards.
+// Returns false if the display does not exist.
+bool badgert_display_stats(int display, display_stats_t *stats, bool reset);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,188 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Display ABI functions that are not part of the badge SDK's display.h.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pixel formats.
+typedef enum {
+	// Unspecified; pixels are passed on as-is.
+	DISPLAY_FMT_RAW,
+	// 16-bit RGB565, most significant byte first.
+	DISPLAY_FMT_RGB565_BE,
+	// 16-bit RGB565, least significant byte first.
+	DISPLAY_FMT_RGB565_LE,
+	// 24-bit RGB, stored as red, green, blue bytes.
+	DISPLAY_FMT_RGB888,
+	// 32-bit `0xAARRGGBB` words in native byte order; alpha is ignored.
+	DISPLAY_FMT_ARGB8888,
+	// 1 bit per pixel, most significant bit first, 1 is white; rows are padded to whole bytes.
+	DISPLAY_FMT_MONO,
+	// 2-bit grey levels, most significant bits first, 3 is white; rows are padded to whole bytes.
+	DISPLAY_FMT_GREY2,
+} display_fmt_t;
+
+// Number of buckets in the display latency histogram.
+#define DISPLAY_STATS_BUCKETS 12
+// Upper bound in microseconds of the first latency bucket; each next bucket doubles it.
+#define DISPLAY_STATS_BUCKET_US 250
+
+// Performance counters of a display.
+typedef struct {
+	// Full writes, flushed frames and presents.
+	uint32_t frames;
+	// Partial writes.
+	uint32_t partial_writes;
+	// Bytes passed to the display by apps.
+	uint64_t bytes_in;
+	// Bytes sent to the display's write function.
+	uint64_t bytes_out;
+	// Calls to the display's write function.
+	uint32_t write_calls;
+	// Longest call to the display's write function in microseconds.
+	uint32_t write_time_max_us;
+	// Total time spent in the display's write function in microseconds.
+	uint64_t write_time_us;
+	// Shortest and longest time between two frames in microseconds.
+	uint32_t frame_interval_min_us, frame_interval_max_us;
+	// Total time between frames in microseconds; divide by `frames - 1` for the average.
+	uint64_t frame_interval_total_us;
+	// Time from submitting a write, present or flush until it is done.
+	// Bucket `i` counts latencies below `DISPLAY_STATS_BUCKET_US << i`; the last bucket also counts all longer ones.
+	uint32_t latency_hist[DISPLAY_STATS_BUCKETS];
+	// Panel refreshes started, for displays with a refresh model.
+	uint32_t partial_refreshes, full_refreshes;
+} display_stats_t;
+
+// How the panel of a display shows newly written pixels.
+typedef enum {
+	// Pixels show as soon as they are written, like on an LCD.
+	DISPLAY_REFRESH_NONE,
+	// The whole panel is refreshed at once, like on most e-ink panels.
+	DISPLAY_REFRESH_FULL,
+	// Regions can be refreshed quickly, leaving ghosting behind that a full refresh removes.
+	DISPLAY_REFRESH_PARTIAL,
+	// Like `DISPLAY_REFRESH_PARTIAL`, with a fast greyscale waveform.
+	DISPLAY_REFRESH_FAST_GREY,
+} display_refresh_t;
+
+// Start refreshing a region of a panel whose pixels have been written.
+// `mode` is `DISPLAY_REFRESH_FULL` for a clean refresh or the display's refresh model otherwise.
+typedef bool (*display_refresh_func_t)(display_refresh_t mode, int x, int y, int width, int height, void *cookie);
+
+// Declare the format a display's write function expects (firmware only).
+// Returns success status.
+bool display_set_native_format(int display, display_fmt_t fmt);
+// Declare the format of pixels written to a display.
+// Pixels are converted if it differs from the native format.
+// Returns false if the conversion is not supported.
+bool display_set_format(int display, display_fmt_t fmt);
+
+// Map a DMA-capable framebuffer of a display into the calling process.
+// Its row stride in bytes and pixel format are stored in `stride` and `format`.
+// Draw into it and call `display_present` to send parts of it to the display.
+// Returns NULL on failure.
+void *display_map_fb(int display, size_t *stride, display_fmt_t *format);
+// Unmap the framebuffer of a display from the calling process.
+// Returns success status.
+bool display_unmap_fb(int display);
+// Send a rectangle of the mapped framebuffer to a display.
+// A width or height of 0 sends the whole framebuffer.
+// Use `display_wait` on `display_fence` before drawing into the sent area again.
+// Returns success status.
+bool display_present(int display, int x, int y, int width, int height);
+
+// Start a frame on a display.
+// Partial writes are merged and only sent when `display_flush` is called.
+bool display_begin(int display);
+// Send everything drawn since `display_begin` to a display.
+bool display_flush(int display);
+
+// Make writes to a display asynchronous.
+// Writes return right away and are sent by a separate task; use `display_wait`
+// before reusing a buffer passed to a write.
+// Returns success status.
+bool display_set_async(int display, bool async);
+// Get a fence for the last write to a display.
+// Returns 0 if the display does not exist.
+uint32_t display_fence(int display);
+// Wait until the buffer passed to the write of `fence` is no longer used.
+// A negative timeout waits forever.
+// Returns false on timeout or if the display does not exist.
+bool display_wait(int display, uint32_t fence, int64_t timeout_us);
+// Pace full frames of a display to the rising edge of its tearing effect pin.
+// A negative pin disables pacing.
+// Returns success status.
+bool display_set_vsync(int display, int te_pin);
+
+// Declare how the panel of a display shows new pixels and the function that refreshes it, which gets the write function's cookie (firmware only).
+// Written regions are refreshed together once writes pause for `batch_ms`, or right away after full writes and flushes;
+// a `batch_ms` of 0 refreshes after every write. Regions refreshed partially `ghost_limit` times get a full refresh.
+// Returns success status.
+bool display_set_refresh(int display, display_refresh_t model, display_refresh_func_t func, int batch_ms, int ghost_limit);
+// Refresh what was written to a display right away, or the whole panel with a full refresh if `full` is set.
+// Returns success status.
+bool display_refresh(int display, bool full);
+
+// Limit how long a display occupies its bus at a time and how much it may send.
+// Writes are split into bands of rows that each take at most `band_us` microseconds to send,
+// measured from earlier writes, and other tasks of equal or higher priority may use the bus between bands.
+// Once a write exceeds `bytes_per_sec`, the writer sleeps after it until the budget has recovered.
+// A `band_us` of 0 sends writes in one piece and a `bytes_per_sec` of 0 does not limit bandwidth.
+// Returns false if the display does not exist.
+bool display_set_schedule(int display, uint32_t band_us, uint32_t bytes_per_sec);
+
+// Get the performance counters of a display, optionally resetting them afterwards.
+// Returns false if the display does not exist.
+bool display_stats(int display, display_stats_t *stats, bool reset);
+
+// Pixels equal to the key colour of a layer are transparent.
+#define DISPLAY_LAYER_COLORKEY 0x01
+
+// Create, move or resize the calling process's layer on a display.
+// Once a display has layers, writes from each process go to its own layer and
+// coordinates are relative to that layer; layers are drawn in increasing `z` order.
+// A width or height of 0 removes the layer.
+// Returns success status.
+bool display_layer(int display, int x, int y, int width, int height, int z);
+// Set the opacity of the calling process's layer on a display, and optionally a colour that is transparent.
+// The colour is in the display's pixel format, as stored in memory.
+// Returns success status.
+bool display_layer_blend(int display, uint8_t alpha, uint32_t flags, uint32_t key);
+// Remove the calling process's layer from a display.
+// Returns success status.
+bool display_layer_remove(int display);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,104 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Native 2D drawing ABI functions.
+
+#pragma once
+
+#include "displayabi.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A rectangle in pixels.
+typedef struct {
+	int x, y, width, height;
+} draw_rect_t;
+
+// A buffer to draw on, such as an app's frame or a mapped display framebuffer.
+typedef struct {
+	// Top left pixel.
+	void         *pixels;
+	// Distance in bytes between rows.
+	size_t        stride;
+	// Size in pixels.
+	int           width, height;
+	// Pixel format; `DISPLAY_FMT_RAW` and `DISPLAY_FMT_GREY2` are not supported.
+	display_fmt_t format;
+	// Bounding box of everything drawn since the app last cleared it; a width of 0 means nothing was drawn.
+	// Pass it to `display_write_partial` or `display_present` to only send what changed.
+	draw_rect_t   damage;
+} draw_surface_t;
+
+// A fixed-size bitmap font.
+// The font data must not change while it is in use, because rendered glyphs are cached.
+typedef struct {
+	// Glyphs, each `height` rows of `(width + 7) / 8` bytes, most significant bit first.
+	const uint8_t *glyphs;
+	// Size of every glyph in pixels.
+	uint8_t        width, height;
+	// Character of the first glyph.
+	uint8_t        first;
+	// Number of glyphs.
+	uint16_t       count;
+} draw_font_t;
+
+// Blit flag: source pixels equal to the key colour are not drawn.
+#define DRAW_BLIT_COLORKEY 0x01
+// Text flag: fill the background of each glyph.
+#define DRAW_TEXT_OPAQUE   0x01
+
+// Get the pixel value of a colour in a format, as used by the drawing functions.
+// Colours are stored in memory as the first bytes of the value; `DISPLAY_FMT_MONO` uses 0 and 1.
+uint32_t draw_color(display_fmt_t format, uint8_t red, uint8_t green, uint8_t blue);
+
+// Fill a rectangle, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_fill_rect(draw_surface_t *surface, int x, int y, int width, int height, uint32_t color);
+// Draw a horizontal line, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_hline(draw_surface_t *surface, int x, int y, int width, uint32_t color);
+// Draw a vertical line, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_vline(draw_surface_t *surface, int x, int y, int height, uint32_t color);
+// Draw a line between two points, clipped to the surface.
+// Returns false if the surface is invalid.
+bool draw_line(draw_surface_t *surface, int x0, int y0, int x1, int y1, uint32_t color);
+// Copy a rectangle of `src` at (`sx`, `sy`) to (`x`, `y`) on `dst`, clipped to both surfaces.
+// Pixels are converted if the formats differ, except with `DRAW_BLIT_COLORKEY`, where `key` is in the source format.
+// Returns false if a surface is invalid or the formats can't be converted.
+bool draw_blit(draw_surface_t *dst, int x, int y, const draw_surface_t *src, int sx, int sy, int width, int height, uint32_t flags, uint32_t key);
+// Draw `len` characters of text with its top left corner at (`x`, `y`), clipped to the surface.
+// A newline starts a new line below `x`; characters without a glyph are skipped.
+// Returns the horizontal position after the last character, or `x` if the surface or font is invalid.
+int draw_text(draw_surface_t *surface, const draw_font_t *font, int x, int y, const char *text, size_t len, uint32_t fg, uint32_t bg, uint32_t flags);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,99 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Prepared I2C transactions, which can be run many times without being built again,
+// either right away or in the background by the interface's bus worker.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One transaction of a batch.
+typedef struct {
+	// Handle returned by `i2c_txn_prepare`.
+	int            txn;
+	// Bytes to write, as many as the transaction was prepared with.
+	const uint8_t *write_buf;
+	// Where to store the bytes read, as many as the transaction was prepared with.
+	uint8_t       *read_buf;
+	// Set to whether the transaction succeeded.
+	bool           ok;
+} i2c_batch_t;
+
+// A completed asynchronous transfer, as returned by `i2c_wait_done`.
+typedef struct {
+	// ID returned by `i2c_txn_submit`.
+	int   id;
+	// Transaction that ran.
+	int   txn;
+	// Cookie passed to `i2c_txn_submit`.
+	void *cookie;
+	// Whether the transfer succeeded.
+	bool  ok;
+} i2c_done_t;
+
+// Set the highest clock frequency of an I2C device (I2C host only).
+// The interface switches to it for each transaction of the calling process addressing the device;
+// devices that the process did not set one for are addressed at 100 kHz.
+// Returns whether the operation was successful.
+bool i2c_set_device_speed(int interface, int device, uint32_t max_hz);
+
+// Prepare an I2C transaction (I2C host only): address `device`, write `write_len` bytes,
+// then if `read_len` is not 0, a repeated start and read `read_len` bytes.
+// Automatically chooses 7-bit or 10-bit I2C device addressing.
+// Returns a handle, or -1 on failure.
+int i2c_txn_prepare(int interface, int device, size_t write_len, size_t read_len);
+// Free a prepared I2C transaction.
+// Returns success status.
+bool i2c_txn_free(int txn);
+// Run a prepared I2C transaction, writing from `write_buf` and reading into `read_buf`.
+// Returns whether the operation was successful.
+bool i2c_txn_exec(int txn, const uint8_t *write_buf, uint8_t *read_buf);
+// Run several prepared I2C transactions back to back, without other transactions in between.
+// Returns the number of transactions that succeeded.
+size_t i2c_txn_exec_batch(i2c_batch_t *batch, size_t count);
+
+// Queue a prepared I2C transaction to run in the background.
+// The bytes to write are copied right away; the bytes read are copied to `read_buf`
+// when the transfer is collected with `i2c_txn_wait` or `i2c_wait_done`.
+// Returns a transfer ID, or -1 if the transfer queue is full.
+int i2c_txn_submit(int txn, const uint8_t *write_buf, uint8_t *read_buf, void *cookie);
+// Wait for an asynchronous I2C transfer to complete.
+// A negative timeout waits forever, zero does not wait.
+// Returns 1 if it succeeded, 0 if it failed, or -1 if it did not complete in time or does not exist.
+int i2c_txn_wait(int id, int64_t timeout_us);
+// Wait for asynchronous I2C transfers to complete and copy up to `cap` of them to `buf`.
+// A negative timeout waits forever, zero does not wait.
+// Returns the number of transfers, which may be 0 before the timeout ends, or -1 if none were submitted.
+int i2c_wait_done(i2c_done_t *buf, size_t cap, int64_t timeout_us);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,72 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// GPIO pin change events, as returned by `io_wait_events`.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A single pin change.
+typedef struct {
+	// Handler passed to `io_attach_isr` or `io_attach_isr_cookie`.
+	void   (*isr)(int pin, void *cookie);
+	// Cookie passed to `io_attach_isr_cookie`, or NULL.
+	void    *cookie;
+	// Time of the change in microseconds since boot.
+	int64_t  time_us;
+	// Pin that changed.
+	uint16_t pin;
+	// Level of the pin just after the change.
+	uint8_t  level;
+	uint8_t  _reserved[5];
+} io_event_t;
+
+// Wait for pin change events and copy up to `cap` of them to `buf`.
+// A negative timeout waits forever, zero does not wait.
+// Returns the number of events, which may be 0 before the timeout ends, or -1 if no handlers are attached.
+int io_wait_events(io_event_t *buf, size_t cap, int64_t timeout_us);
+// Get the number of pin change events discarded because the event queue was full.
+uint32_t io_events_dropped(void);
+
+// Wait for pin change events and run their handlers in the calling task.
+// Returns the number of handlers run, or -1 if no handlers are attached.
+static inline int io_dispatch_events(int64_t timeout_us) {
+	io_event_t buf[16];
+	int count = io_wait_events(buf, sizeof(buf) / sizeof(*buf), timeout_us);
+	for (int i = 0; i < count; i++) {
+		buf[i].isr(buf[i].pin, buf[i].cookie);
+	}
+	return count;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,47 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Reading and writing several GPIO pins at once.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Read the level of all input pins in one operation, with bit N holding pin N.
+// Bits of pins that cannot be inputs are 0; bits of pins set to output are UNSPECIFIED.
+uint32_t io_read_mask(void);
+// Drive the pins in `set_mask` high and the pins in `clear_mask` low, with bit N selecting pin N.
+// The pins in `set_mask` change just before the pins in `clear_mask`.
+// If a pin is set to input, the resulting behaviour is UNSPECIFIED.
+// Returns false without changing any pin if a pin cannot be an output or is in both masks.
+bool io_write_mask(uint32_t set_mask, uint32_t clear_mask);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,116 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+#include "badgert.h"
+#include "abi.hpp"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <driver/gptimer.h>
+#include <esp_attr.h>
+#include <esp_rom_sys.h>
+
+#include <algorithm>
+#include <vector>
+
+
+
+// Interrupt latency measurement: a hardware timer alarm is armed and the ISR
+// reports how many timer ticks passed between the alarm and the callback running.
+namespace irqlat {
+
+// Timer resolution, chosen to be high enough to resolve a few CPU cycles.
+static const uint32_t RESOLUTION = 40000000;
+// Time between arming the alarm and it firing, in timer ticks.
+static const uint64_t DELAY      = 4000;
+
+// Task to notify of a completed measurement.
+static TaskHandle_t waiter;
+// Latency of the last measurement, in timer ticks.
+static volatile uint64_t latency;
+
+// Alarm callback: record latency and wake up the measuring task.
+static IRAM_ATTR bool onAlarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *) {
+	latency = edata->count_value - edata->alarm_value;
+	BaseType_t woken = pdFALSE;
+	vTaskNotifyGiveFromISR(waiter, &woken);
+	return woken == pdTRUE;
+}
+
+} // namespace irqlat
+
+// Measure interrupt latency from a timer alarm to its ISR, printing the result in CPU cycles.
+// Run once idle and once while an app is running to compare both cases.
+// Returns success status.
+extern "C" bool badgert_irq_latency(size_t samples) {
+	using namespace irqlat;
+	if (!samples) return false;
+	
+	gptimer_handle_t timer;
+	gptimer_config_t config = {
+		.clk_src       = GPTIMER_CLK_SRC_DEFAULT,
+		.direction     = GPTIMER_COUNT_UP,
+		.resolution_hz = RESOLUTION,
+	};
+	if (gptimer_new_timer(&config, &timer) != ESP_OK) return false;
+	gptimer_event_callbacks_t cbs = {
+		.on_alarm = onAlarm,
+	};
+	gptimer_register_event_callbacks(timer, &cbs, nullptr);
+	gptimer_enable(timer);
+	waiter = xTaskGetCurrentTaskHandle();
+	
+	// Take samples.
+	std::vector<uint32_t> cycles;
+	cycles.reserve(samples);
+	uint32_t cpuMHz = esp_rom_get_cpu_ticks_per_us();
+	for (size_t i = 0; i < samples; i++) {
+		gptimer_alarm_config_t alarm = {
+			.alarm_count = DELAY,
+		};
+		gptimer_set_raw_count(timer, 0);
+		gptimer_set_alarm_action(timer, &alarm);
+		gptimer_start(timer);
+		bool fired = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+		gptimer_stop(timer);
+		if (fired) {
+			cycles.push_back(latency * cpuMHz * 1000000 / RESOLUTION);
+		}
+	}
+	
+	gptimer_disable(timer);
+	gptimer_del_timer(timer);
+	if (cycles.empty()) return false;
+	
+	// Report in the same format as `bench/abibench.c`.
+	std::sort(cycles.begin(), cycles.end());
+	const char *name = abi::getContexts().empty() ? "irq_idle" : "irq_app";
+	printf("irqbench: %s min %lu med %lu p99 %lu\n", name,
+		(unsigned long) cycles[0],
+		(unsigned long) cycles[cycles.size() / 2],
+		(unsigned long) cycles[cycles.size() * 99 / 100]
+	);
+	return true;
+}
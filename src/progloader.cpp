@@ -27,10 +27,6 @@
 #include <esp_log.h>
 static const char *TAG = "badgeloader";
 
-#ifdef CONFIG_BADGEABI_ENABLE_MPU
-#include <mpu.hpp>
-#endif
-
 namespace loader {
 
 
@@ -91,13 +87,6 @@ bool Linkage::loadLibrary(const std::string &filename, FILE *fd) {
 	files.push_back(std::move(elf));
 	filenames.push_back(filename);
 	
-	#ifdef CONFIG_BADGEABI_ENABLE_MPU
-	// Apply MPU settings.
-	if (!mpu::applyPH(elf, prog)) {
-		ESP_LOGW(TAG, "Applying MPU settings failed, ignoring.");
-	}
-	#endif
-	
 	ESP_LOGI(TAG, "%s loaded to 0x%08zx (offset 0x%08zx)", filename.c_str(), (size_t) prog.vaddr_real, (size_t) prog.vaddr_offset());
 	return true;
 }
@@ -28,6 +28,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 
+#include <esp_attr.h>
 #include <esp_log.h>
 static const char *TAG = "badgert";
 
@@ -103,6 +104,19 @@ static std::vector<std::string> searchPath;
 
 
 #ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+static_assert(CONFIG_BADGEABI_KERNEL_TLS_INDEX < configNUM_THREAD_LOCAL_STORAGE_POINTERS,
+	"BADGEABI_KERNEL_TLS_INDEX must be less than FREERTOS_THREAD_LOCAL_STORAGE_POINTERS");
+
+// Called by the linker-wrapped scheduler after it selected a new task.
+// Loads the kernel context of the new task, so user processes can be preempted
+// and ABI functions can block without losing track of the active context.
+extern "C" void __real_vTaskSwitchContext(BaseType_t core);
+extern "C" IRAM_ATTR void __wrap_vTaskSwitchContext(BaseType_t core) {
+	__real_vTaskSwitchContext(core);
+	auto ctx = pvTaskGetThreadLocalStoragePointer(NULL, CONFIG_BADGEABI_KERNEL_TLS_INDEX);
+	kernel::switchCtx((kernel::ctx_t *) ctx);
+}
+
 // Set up user context and run user code.
 int runUserCode(bool &success, kernel::ctx_t &kctx, loader::Linkage &prog, abi::Context &actx, int argc, const char **argv, const char **envp) {
 	memset(&kctx.u_regs, 0, sizeof(kctx.u_regs));
@@ -115,6 +129,16 @@ int runUserCode(bool &success, kernel::ctx_t &kctx, loader::Linkage &prog, abi::
 	}
 	kctx.u_regs.sp += CONFIG_BADGERT_STACK_DEPTH * sizeof(long);
 	
+	#ifdef CONFIG_BADGEABI_ENABLE_MPU
+	// Precompute memory protection, loaded whenever this task is switched in.
+	kctx.u_pmp_valid = actx.buildPMP(kctx.u_pmp);
+	if (!kctx.u_pmp_valid) {
+		ESP_LOGE(TAG, "Process %d has too many memory regions for the PMP", kctx.pid);
+		success = false;
+		return -1;
+	}
+	#endif
+	
 	// Measure envp.
 	// int envp_len;
 	// for (envp_len = 0; envp[envp_len]; envp_len++);
@@ -143,6 +167,7 @@ int runUserCode(bool &success, kernel::ctx_t &kctx, loader::Linkage &prog, abi::
 	asm volatile ("mv %0, tp" : "=r" (kctx.u_regs.tp));
 	
 	// Run user program.
+	vTaskSetThreadLocalStoragePointer(NULL, CONFIG_BADGEABI_KERNEL_TLS_INDEX, &kctx);
 	kernel::setCtx(&kctx);
 	asm volatile (
 		"  fence\n"		// Fence for user data
@@ -169,7 +194,7 @@ static void taskCode(void *context) {
 	
 	#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
 	// Allocate a kernel context.
-	kernel::ctx_t kctx;
+	kernel::ctx_t kctx = {};
 	kctx.pid = actx.getPID();
 	#endif
 	
@@ -179,6 +204,9 @@ static void taskCode(void *context) {
 	const char *envp[] = { NULL };
 	
 	#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	// Set context for ABI calls, which run in this task.
+	abi::setContext(actx.getPID());
+	
 	// Run user code.
 	bool success;
 	int ec = runUserCode(success, kctx, prog, actx, argc, argv, envp);
@@ -188,6 +216,7 @@ static void taskCode(void *context) {
 		ESP_LOGE(TAG, "Unable to run process %d\n", kctx.pid);
 	}
 	
+	vTaskSetThreadLocalStoragePointer(NULL, CONFIG_BADGEABI_KERNEL_TLS_INDEX, NULL);
 	kernel::setDefaultCtx();
 	#else
 	// Set context.
@@ -448,4 +477,52 @@ extern "C" void badgert_remove_search_dir(const char *path) {
 	removeSearchDir(path);
 }
 
+
+#ifdef CONFIG_BADGEABI_BENCH
+// Benchmark app embedded by CMakeLists.txt.
+extern const uint8_t abibench_start[] asm("_binary_abibench_elf_start");
+extern const uint8_t abibench_end[]   asm("_binary_abibench_elf_end");
+#endif
+
+// Start the ABI call benchmark app built into the firmware with CONFIG_BADGEABI_BENCH.
+// Results are printed for `tools/benchcmp.py` to compare against a baseline.
+// Returns false if there is no built-in benchmark app or it could not be started.
+extern "C" bool badgert_bench() {
+#ifdef CONFIG_BADGEABI_BENCH
+	FILE *fd = fmemopen((void *) abibench_start, abibench_end - abibench_start, "rb");
+	return fd && startFD("abibench.elf", fd);
+#else
+	return false;
+#endif
+}
+
+
+// Enable or disable the kernel trace buffer.
+// Returns false if the kernel is not enabled.
+extern "C" bool badgert_trace_enable(bool enable) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	kernel::trace::setEnabled(enable);
+	return true;
+#else
+	return false;
+#endif
+}
+
+// Discard all events in the kernel trace buffer.
+extern "C" void badgert_trace_clear() {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	kernel::trace::clear();
+#endif
+}
+
+// Write the kernel trace buffer to a file, to be converted by `tools/ktrace2json.py`.
+// Returns success status.
+extern "C" bool badgert_trace_dump(FILE *fd) {
+#ifdef CONFIG_BADGEABI_ENABLE_KERNEL
+	return abi::dumpTrace(fd);
+#else
+	return false;
+#endif
+}
+
 }
@@ -0,0 +1,82 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// Retained tile map and sprite ABI functions.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tile index that draws nothing, so the background colour shows.
+#define SCENE_TILE_NONE 0xffff
+// Sprite flag: pixels equal to the key colour are transparent.
+#define SCENE_SPRITE_COLORKEY 0x01
+
+// Create a scene on a display for the calling process, replacing the previous one.
+// The runtime renders it band by band while sending, so the app needs no framebuffer.
+// `tiles` holds `tile_count` tiles of `tile_width` by `tile_height` pixels one after another,
+// in the format written to the display; it is copied.
+// The map is `cols` by `rows` tiles of `SCENE_TILE_NONE` and repeats in both directions.
+// Returns success status.
+bool scene_create(int display, const void *tiles, int tile_width, int tile_height, int tile_count, int cols, int rows);
+// Remove the calling process's scene from a display.
+// Returns success status.
+bool scene_destroy(int display);
+// Set the colour shown where no tile or sprite is drawn, as stored in memory.
+// Returns success status.
+bool scene_set_background(int display, uint32_t color);
+// Set a rectangle of `cols` by `rows` map entries starting at (`col`, `row`) to tile indices from `tiles`.
+// Returns success status.
+bool scene_set_tiles(int display, int col, int row, int cols, int rows, const uint16_t *tiles);
+// Set the map position in pixels shown at the top left of the display.
+// The map wraps, so the position is taken modulo its size.
+// Returns success status.
+bool scene_scroll(int display, int x, int y);
+// Add a sprite with a copy of `pixels`, in the format written to the display; it starts hidden.
+// With `SCENE_SPRITE_COLORKEY`, pixels equal to `key` as stored in memory are transparent.
+// Returns the sprite's ID, or -1 on failure.
+int scene_sprite_add(int display, const void *pixels, int width, int height, uint32_t flags, uint32_t key);
+// Move a sprite and set its stacking order; higher `z` is on top.
+// Returns success status.
+bool scene_sprite_move(int display, int sprite, int x, int y, int z);
+// Show or hide a sprite.
+// Returns success status.
+bool scene_sprite_show(int display, int sprite, bool visible);
+// Remove a sprite.
+// Returns success status.
+bool scene_sprite_remove(int display, int sprite);
+// Render the scene and send it to the display.
+// Like other writes, this returns right away if the display is asynchronous.
+// Returns success status.
+bool scene_render(int display);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,71 @@
+/*
+	MIT License
+
+	Copyright    (c) 2023 Julian Scheffers
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy
+	of this software and associated documentation files    (the "Software"), to deal
+	in the Software without restriction, including without limitation the rights
+	to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+	copies of the Software, and to permit persons to whom the Software is
+	furnished to do so, subject to the following conditions:
+
+	The above copyright notice and this permission notice shall be included in all
+	copies or substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+	IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+	FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+	AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+	SOFTWARE.
+*/
+
+// SPI host: devices with their own clock and mode on a shared bus,
+// with polling transfers for short messages and queued DMA transfers for long ones.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Get the number of SPI buses apps can use.
+int io_cap_spi_count(void);
+// Get the highest clock speed in Hertz of an SPI bus.
+// Returns 0 if the bus does not exist.
+uint32_t io_cap_spi_speed(int bus);
+
+// Set up an SPI bus as host; `miso` may be -1 if the bus only sends.
+// Calling it again with the same pins succeeds without changing anything.
+// Returns whether the operation was successful.
+bool spi_host_init(int bus, int sclk, int mosi, int miso);
+// Add a device to an SPI bus with its own chip select pin (or -1), clock speed and SPI mode (0-3).
+// Returns a device handle, or -1 on failure.
+int spi_device_add(int bus, int cs, uint32_t clock_hz, int mode);
+// Remove an SPI device, waiting for its queued transfers first.
+// Returns success status.
+bool spi_device_remove(int device);
+
+// Send `len` bytes from `tx` while receiving `len` bytes into `rx`, and wait for it to finish.
+// Either buffer may be NULL. Meant for short messages; waits for queued transfers of the device first.
+// Returns whether the operation was successful.
+bool spi_transfer(int device, const void *tx, void *rx, size_t len);
+// Queue a DMA transfer of `len` bytes from `tx` while receiving into `rx`; either buffer may be NULL.
+// The buffers are used directly and must remain valid until `spi_wait` returns true for the transfer.
+// Unmapping memory first waits for all queued transfers of the process.
+// Returns a transfer ID, or -1 if the transfer queue is full.
+int spi_submit(int device, const void *tx, void *rx, size_t len);
+// Wait for a queued SPI transfer to finish.
+// A negative timeout waits forever, zero does not wait.
+// Returns whether the transfer finished; false if it did not finish in time or does not exist.
+bool spi_wait(int device, int id, int64_t timeout_us);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+
+# MIT License
+#
+# Copyright (c) 2023 Julian Scheffers
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Compares the output of `bench/abibench.c` and `badgert_irq_latency` against a
+# baseline, so trap overhead and interrupt latency regressions can be caught in CI,
+# whether the output came from real hardware or from an emulator.
+
+import argparse, json, re, sys
+
+# Format of a single benchmark result line.
+RESULT = re.compile(r"(?:abibench|irqbench): (\S+) min (\d+) med (\d+) p99 (\d+)")
+
+# Parse benchmark output into a dict of name -> { min, med, p99 }.
+def parse(text):
+	out = {}
+	for match in RESULT.finditer(text):
+		name, lo, med, p99 = match.groups()
+		out[name] = { "min": int(lo), "med": int(med), "p99": int(p99) }
+	return out
+
+def main():
+	parser = argparse.ArgumentParser(description="Compare ABI benchmark results against a baseline.")
+	parser.add_argument("results", help="Captured console output of the benchmark app")
+	parser.add_argument("--baseline", help="Baseline JSON file to compare against")
+	parser.add_argument("--save", help="Write the parsed results as a baseline JSON file")
+	parser.add_argument("--tolerance", type=float, default=10, help="Allowed median regression in percent (default: 10)")
+	args = parser.parse_args()
+	
+	with open(args.results) as fd:
+		results = parse(fd.read())
+	if not results:
+		print("No benchmark results found", file=sys.stderr)
+		return 1
+	
+	if args.save:
+		with open(args.save, "w") as fd:
+			json.dump(results, fd, indent="\t", sort_keys=True)
+	
+	if not args.baseline:
+		for name, res in sorted(results.items()):
+			print("{:24} min {:8} med {:8} p99 {:8}".format(name, res["min"], res["med"], res["p99"]))
+		return 0
+	
+	with open(args.baseline) as fd:
+		baseline = json.load(fd)
+	
+	# Compare medians, which are less noisy than the tails.
+	failed = False
+	for name, base in sorted(baseline.items()):
+		if name not in results:
+			print("{:24} missing".format(name))
+			failed = True
+			continue
+		old, new = base["med"], results[name]["med"]
+		change   = (new - old) * 100 / old if old else 0
+		status   = "REGRESSED" if change > args.tolerance else "ok"
+		failed   = failed or status != "ok"
+		print("{:24} med {:8} -> {:8} ({:+6.1f}%) {}".format(name, old, new, change, status))
+	
+	return 1 if failed else 0
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+
+# MIT License
+#
+# Copyright (c) 2023 Julian Scheffers
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Converts a kernel trace dump written by `badgert_trace_dump` into
+# Chrome trace event JSON, which can be opened in Perfetto or chrome://tracing.
+
+import argparse, json, struct, sys
+
+# Layout of `kernel::trace::entry_t`.
+ENTRY = struct.Struct("<BBHIQQII")
+
+# Values of `kernel::trace::event_t`.
+EV_ABICALL, EV_PROC_START, EV_PROC_EXIT, EV_TRAP, EV_CTX_SWITCH = range(5)
+
+# Names of RISC-V trap causes.
+TRAP_NAMES = {
+	0:  "instruction address misaligned",
+	1:  "instruction access fault",
+	2:  "illegal instruction",
+	3:  "trace/breakpoint trap",
+	4:  "load address misaligned",
+	5:  "load access fault",
+	6:  "store/AMO address misaligned",
+	7:  "store/AMO access fault",
+	8:  "ECALL from U-mode",
+	9:  "ECALL from S-mode",
+	11: "ECALL from M-mode",
+	12: "instruction page fault",
+	13: "load page fault",
+	15: "store/AMO page fault",
+}
+
+class Reader:
+	def __init__(self, data):
+		self.data = data
+		self.pos  = 0
+	
+	def read(self, length):
+		if self.pos + length > len(self.data):
+			raise ValueError("Truncated trace dump")
+		out = self.data[self.pos:self.pos+length]
+		self.pos += length
+		return out
+	
+	def word(self):
+		return struct.unpack("<I", self.read(4))[0]
+
+# Parse a trace dump into (ticks_per_us, names, dropped, entries).
+def parse(data):
+	rd = Reader(data)
+	if rd.read(4) != b"KTRC":
+		raise ValueError("Not a kernel trace dump")
+	version = rd.word()
+	if version != 1:
+		raise ValueError("Unsupported trace dump version {}".format(version))
+	ticks_per_us = rd.word() or 1
+	harts        = rd.word()
+	
+	names = []
+	for _ in range(rd.word()):
+		names.append(rd.read(rd.word()).decode(errors="replace"))
+	
+	dropped = []
+	entries = []
+	for _ in range(harts):
+		dropped.append(rd.word())
+		for _ in range(rd.word()):
+			entries.append(ENTRY.unpack(rd.read(ENTRY.size)))
+	
+	return ticks_per_us, names, dropped, entries
+
+# Convert parsed trace data into a list of Chrome trace events.
+def convert(ticks_per_us, names, dropped, entries):
+	events = []
+	if not entries:
+		return events
+	base = min(e[4] for e in entries)
+	
+	def ts(cycles):
+		return (cycles - base) / ticks_per_us
+	
+	def abiname(index):
+		return names[index] if index < len(names) else "abi#{}".format(index)
+	
+	pids = set()
+	for type, hart, pid, arg, start, end, retval, _ in entries:
+		pids.add(pid)
+		common = { "pid": pid, "tid": hart, "ts": ts(start) }
+		if type == EV_ABICALL:
+			events.append(dict(common, ph="X", cat="abi", name=abiname(arg),
+				dur=(end - start) / ticks_per_us, args={ "index": arg, "retval": retval }))
+		elif type == EV_PROC_START:
+			events.append(dict(common, ph="i", s="p", cat="proc", name="start",
+				args={ "entry": hex(retval) }))
+		elif type == EV_PROC_EXIT:
+			events.append(dict(common, ph="i", s="p", cat="proc", name="exit",
+				args={ "code": struct.unpack("<i", struct.pack("<I", retval))[0] }))
+		elif type == EV_TRAP:
+			events.append(dict(common, ph="i", s="t", cat="trap",
+				name=TRAP_NAMES.get(arg, "trap 0x{:x}".format(arg)), args={ "pc": hex(retval) }))
+		elif type == EV_CTX_SWITCH:
+			events.append(dict(common, ph="i", s="g", cat="sched", name="switch",
+				args={ "to": arg }))
+	
+	# Name the processes so the viewer doesn't just show numbers.
+	for pid in sorted(pids):
+		events.append({ "ph": "M", "pid": pid, "name": "process_name",
+			"args": { "name": "kernel" if pid == 0 else "process {}".format(pid) } })
+	for hart, count in enumerate(dropped):
+		if count:
+			print("Warning: {} events overwritten on hart {}".format(count, hart), file=sys.stderr)
+	
+	return events
+
+def main():
+	parser = argparse.ArgumentParser(description="Convert a kernel trace dump to Chrome trace JSON.")
+	parser.add_argument("input", help="Trace dump written by badgert_trace_dump")
+	parser.add_argument("output", nargs="?", help="Output JSON file (default: stdout)")
+	args = parser.parse_args()
+	
+	with open(args.input, "rb") as fd:
+		events = convert(*parse(fd.read()))
+	
+	out = { "traceEvents": events, "displayTimeUnit": "ns" }
+	if args.output:
+		with open(args.output, "w") as fd:
+			json.dump(out, fd)
+	else:
+		json.dump(out, sys.stdout)
+
+if __name__ == "__main__":
+	main()